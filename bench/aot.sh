@@ -0,0 +1,28 @@
+#!/usr/bin/env bash
+# Times a program in the interpreter against its ahead-of-time compiled
+# executable, checking that both print the same.
+# Usage: bench/aot.sh [program.mpl] [input]
+
+cd "$(dirname "$0")/.."
+bin=./build/mini-pl
+program=${1:-bench/recurrence.mpl}
+input=${2:-5000000}
+out=$(mktemp)
+
+$bin -c "$program" -o "$out" || exit 1
+
+run() {
+  local name=$1 start end ms
+  shift
+  start=$(date +%s%N)
+  echo "$input" | "$@" >"$out.txt"
+  end=$(date +%s%N)
+  ms=$(((end - start) / 1000000))
+  printf "%-10s %6d ms  %s\n" "$name" "$ms" "$(head -c 40 "$out.txt" | tr '\n' ' ')"
+}
+
+run walker $bin --walker "$program"
+run vm $bin --jit=off "$program"
+run jit $bin "$program"
+run compiled "$out"
+rm -f "$out" "$out.txt"
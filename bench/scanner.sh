@@ -0,0 +1,29 @@
+#!/usr/bin/env bash
+# Scanner throughput in MB/s at each vector level the CPU supports, on a
+# generated program of long comments and strings and on one of dense code.
+# Usage: bench/scanner.sh [lines]
+
+cd "$(dirname "$0")/.."
+bin=./build/mini-pl
+lines=${1:-500000}
+text=$(mktemp)
+code=$(mktemp)
+
+awk -v n="$lines" 'BEGIN {
+  print "var s : string := \"\";"
+  for (i = 0; i < n; i++) {
+    print "// generated rule " i ", checks the customer record field by field"
+    print "s := \"record " i ": the quick brown fox jumps over the lazy dog\";"
+  }
+}' >"$text"
+awk -v n="$lines" 'BEGIN {
+  print "var s : int := 0;"
+  for (i = 0; i < n; i++)
+    print "var v" i " : int := (s + " i ") * 2; s := s + v" i ";"
+}' >"$code"
+
+echo "comments and strings ($(du -h "$text" | cut -f1)):"
+$bin --bench-scan "$text"
+echo "dense code ($(du -h "$code" | cut -f1)):"
+$bin --bench-scan "$code"
+rm -f "$text" "$code"
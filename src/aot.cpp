@@ -0,0 +1,450 @@
+#include "aot.h"
+#include "compiler.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <unistd.h>
+#include <vector>
+
+namespace Aot {
+
+using Runtime::ValueType;
+
+// Runtime of the generated programs. Strings are reference counted; every
+// string expression yields a reference its consumer releases. Literals are
+// static and never freed.
+static const char *RUNTIME = R"(#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct mpl_str {
+  long refs; /* negative for literals */
+  size_t length;
+  char *chars;
+} mpl_str;
+
+static mpl_str mpl_empty = {-1, 0, ""};
+
+static mpl_str *mpl_ref(mpl_str *s) {
+  if (s->refs >= 0)
+    s->refs++;
+  return s;
+}
+static void mpl_unref(mpl_str *s) {
+  if (s->refs >= 0 && --s->refs == 0)
+    free(s);
+}
+static void mpl_set(mpl_str **var, mpl_str *s) {
+  mpl_unref(*var);
+  *var = s;
+}
+static mpl_str *mpl_alloc(size_t length) {
+  mpl_str *s = malloc(sizeof(mpl_str) + length + 1);
+  if (!s)
+    abort();
+  s->refs = 1;
+  s->length = length;
+  s->chars = (char *)(s + 1);
+  s->chars[length] = '\0';
+  return s;
+}
+static mpl_str *mpl_concat(mpl_str *a, mpl_str *b) {
+  mpl_str *s = mpl_alloc(a->length + b->length);
+  memcpy(s->chars, a->chars, a->length);
+  memcpy(s->chars + a->length, b->chars, b->length);
+  mpl_unref(a);
+  mpl_unref(b);
+  return s;
+}
+static int mpl_compare(mpl_str *a, mpl_str *b) {
+  size_t n = a->length < b->length ? a->length : b->length;
+  int c = memcmp(a->chars, b->chars, n);
+  if (c == 0)
+    c = (a->length > b->length) - (a->length < b->length);
+  mpl_unref(a);
+  mpl_unref(b);
+  return c;
+}
+static bool mpl_less(mpl_str *a, mpl_str *b) { return mpl_compare(a, b) < 0; }
+static bool mpl_equal(mpl_str *a, mpl_str *b) {
+  return mpl_compare(a, b) == 0;
+}
+
+static void mpl_error(int line, const char *msg, const char *arg) {
+  fflush(stdout);
+  fprintf(stderr, "[line %d] Runtime error: ", line);
+  fprintf(stderr, msg, arg);
+  fputc('\n', stderr);
+  exit(1);
+}
+static int32_t mpl_div(int32_t l, int32_t r, int line) {
+  if (r == 0)
+    mpl_error(line, "Division by zero", "");
+  /* INT32_MIN / -1 wraps around like the interpreter's */
+  if (r == -1)
+    return (int32_t)(0u - (uint32_t)l);
+  return l / r;
+}
+
+static void mpl_print_int(int32_t i) { printf("%d", i); }
+static void mpl_print_bool(bool b) { fputs(b ? "true" : "false", stdout); }
+static void mpl_print_str(mpl_str *s) {
+  fwrite(s->chars, 1, s->length, stdout);
+  mpl_unref(s);
+}
+
+/* Next whitespace-delimited word of input, empty at end of input */
+static mpl_str *mpl_word(void) {
+  size_t length = 0, capacity = 16;
+  char *buf = malloc(capacity);
+  int c;
+  fflush(stdout);
+  do
+    c = getchar();
+  while (c == ' ' || (c >= '\t' && c <= '\r'));
+  while (c != EOF && c != ' ' && !(c >= '\t' && c <= '\r')) {
+    if (length == capacity)
+      buf = realloc(buf, capacity *= 2);
+    buf[length++] = c;
+    c = getchar();
+  }
+  if (c != EOF)
+    ungetc(c, stdin);
+  mpl_str *s = mpl_alloc(length);
+  memcpy(s->chars, buf, length);
+  free(buf);
+  return s;
+}
+static int32_t mpl_read_int(int line) {
+  mpl_str *s = mpl_word();
+  char *end;
+  errno = 0;
+  long n = strtol(s->chars, &end, 10);
+  if (end == s->chars || *end || errno == ERANGE || n < INT32_MIN ||
+      n > INT32_MAX)
+    mpl_error(line, "Expected an integer, got '%s'", s->chars);
+  mpl_unref(s);
+  return (int32_t)n;
+}
+static bool mpl_read_bool(int line) {
+  mpl_str *s = mpl_word();
+  bool b = strcmp(s->chars, "true") == 0;
+  if (!b && strcmp(s->chars, "false") != 0)
+    mpl_error(line, "Expected true or false, got '%s'", s->chars);
+  mpl_unref(s);
+  return b;
+}
+
+/* State dump of a failed assert. Variables that have not been written yet
+   show as 0. The program goes on but exits with status 1. */
+static int mpl_status = 0;
+static void mpl_diag_begin(void) {
+  mpl_status = 1;
+  fputs("========================\nVariable map:\n", stdout);
+}
+static void mpl_diag_int(const char *id, bool set, int32_t v) {
+  printf("\tid:%s val:%d\n", id, set ? v : 0);
+}
+static void mpl_diag_bool(const char *id, bool set, bool v) {
+  printf("\tid:%s val:%s\n", id, !set ? "0" : v ? "true" : "false");
+}
+static void mpl_diag_str(const char *id, bool set, mpl_str *v) {
+  printf("\tid:%s val:", id);
+  if (set)
+    fwrite(v->chars, 1, v->length, stdout);
+  else
+    putchar('0');
+  putchar('\n');
+}
+static void mpl_diag_stack(void) {
+  fputs("========================\n========================\nExpr stack:\n"
+        "\tbool:false\n",
+        stdout);
+}
+static void mpl_diag_end(void) { fputs("========================\n", stdout); }
+)";
+
+// Quotes s as a C string literal
+static std::string quote(const std::string &s) {
+  std::string o = "\"";
+  for (unsigned char c : s) {
+    if (c == '"' || c == '\\' || c == '?') {
+      o += '\\';
+      o += c;
+    } else if (c >= ' ' && c < 127)
+      o += c;
+    else {
+      char buf[8];
+      snprintf(buf, sizeof buf, "\\%03o", c);
+      o += buf;
+    }
+  }
+  return o + "\"";
+}
+
+// Emits C for a checked program. Expressions leave their C text in result.
+class CWalker : public Parser::TreeWalker {
+public:
+  const Resolver::Symbols &symbols;
+  std::string result;
+  std::string literals;
+  std::string body;
+
+  CWalker(const Resolver::Symbols &s) : symbols(s) {}
+
+  void visitOpnd(const Parser::Opnd *o) override { result = "0"; }
+  void visitInt(const Parser::Int *i) override {
+    int32_t n = i->number();
+    if (n == INT32_MIN)
+      result = "(-2147483647 - 1)";
+    else
+      result = n < 0 ? "(" + std::to_string(n) + ")" : std::to_string(n);
+  }
+  void visitBool(const Parser::Bool *b) override {
+    result = b->value.start[0] == 't' ? "true" : "false";
+  }
+  void visitString(const Parser::String *s) override {
+    std::string chars(s->text);
+    std::string name = "s" + std::to_string(strings++);
+    literals += "static mpl_str " + name + " = {-1, " +
+                std::to_string(chars.size()) + ", (char *)" + quote(chars) +
+                "};\n";
+    result = "&" + name;
+  }
+  void visitIdent(const Parser::Ident *i) override {
+    result = var(i->slot);
+    if (i->type == ValueType::STRING)
+      result = "mpl_ref(" + result + ")";
+  }
+  void visitExpr(const Parser::Expr *e) override { result = "0"; }
+  void visitBinary(const Parser::Binary *b) override {
+    std::string l = expr(b->left);
+    std::string r = expr(b->right);
+    ValueType t = b->left->type;
+    switch (b->op.type) {
+    case Scanner::TokenType::PLUS:
+      result = t == ValueType::STRING ? call("mpl_concat", l, r)
+                                      : "(" + l + " + " + r + ")";
+      break;
+    case Scanner::TokenType::MINUS:
+      result = "(" + l + " - " + r + ")";
+      break;
+    case Scanner::TokenType::ASTERISK:
+      result = "(" + l + " * " + r + ")";
+      break;
+    case Scanner::TokenType::SLASH:
+      result = "mpl_div(" + l + ", " + r + ", " + std::to_string(b->op.line) +
+               ")";
+      break;
+    case Scanner::TokenType::AND:
+      // Both sides are evaluated, as in the VM
+      result = "(" + l + " & " + r + ")";
+      break;
+    case Scanner::TokenType::LESS:
+      result = t == ValueType::STRING ? call("mpl_less", l, r)
+                                      : "(" + l + " < " + r + ")";
+      break;
+    case Scanner::TokenType::EQUAL:
+      result = t == ValueType::STRING ? call("mpl_equal", l, r)
+                                      : "(" + l + " == " + r + ")";
+      break;
+    default:
+      result = "0";
+    }
+  }
+  void visitUnary(const Parser::Unary *u) override {
+    result = "(!" + expr(u->right) + ")";
+  }
+  void visitSingle(const Parser::Single *s) override { s->right->accept(this); }
+  void visitStmt(const Parser::Stmt *s) override {}
+  void visitStmts(const Parser::Stmts *s) override {
+    for (Parser::TreeNode *n : s->stmts)
+      n->accept(this);
+  }
+  void visitVar(const Parser::Var *v) override {
+    ValueType t = symbols.types[v->slot];
+    std::string value;
+    if (v->expr)
+      value = expr(v->expr);
+    else
+      value = t == ValueType::INT    ? "0"
+              : t == ValueType::BOOL ? "false"
+                                     : "&mpl_empty";
+    store(v->slot, value);
+  }
+  void visitAssign(const Parser::Assign *a) override {
+    store(a->slot, expr(a->expr));
+  }
+  void visitFor(const Parser::For *f) override {
+    std::string n = std::to_string(loops);
+    std::string control = var(f->slot);
+    line("{");
+    depth++;
+    line("int32_t from" + n + " = " + expr(f->from) + ";");
+    line("int32_t to" + n + " = " + expr(f->to) + ";");
+    for (uint32_t k = 0; k < f->inductionCount; k++)
+      line("int32_t step" + n + "_" + std::to_string(k) + " = " +
+           expr(f->inductions[k].step) + ";");
+    line(control + " = from" + n + ";");
+    line(flag(f->slot) + " = true;");
+    // Tested before the increment, which wraps around after INT32_MAX
+    line("if (" + control + " <= to" + n + ") do {");
+    loops++;
+    depth++;
+    f->body->accept(this);
+    for (uint32_t k = 0; k < f->inductionCount; k++)
+      line(var(f->inductions[k].slot) + " += step" + n + "_" +
+           std::to_string(k) + ";");
+    depth--;
+    loops--;
+    line("} while (" + control + "++ != to" + n + ");");
+    depth--;
+    line("}");
+  }
+  void visitRead(const Parser::Read *r) override {
+    ValueType t = symbols.types[r->slot];
+    if (t == ValueType::INT)
+      store(r->slot, "mpl_read_int(" + std::to_string(r->ident.line) + ")");
+    else if (t == ValueType::BOOL)
+      store(r->slot, "mpl_read_bool(" + std::to_string(r->ident.line) + ")");
+    else
+      store(r->slot, "mpl_word()");
+  }
+  void visitPrint(const Parser::Print *p) override {
+    ValueType t = p->expr->type;
+    std::string fn = t == ValueType::INT    ? "mpl_print_int"
+                     : t == ValueType::BOOL ? "mpl_print_bool"
+                                            : "mpl_print_str";
+    line(fn + "(" + expr(p->expr) + ");");
+  }
+  void visitAssert(const Parser::Assert *a) override {
+    line("if (!" + expr(a->expr) + ") {");
+    depth++;
+    line("mpl_diag_begin();");
+    std::map<std::string, int> sorted(symbols.slots.begin(),
+                                      symbols.slots.end());
+    for (auto const &[id, slot] : sorted) {
+      ValueType t = symbols.types[slot];
+      std::string fn = t == ValueType::INT    ? "mpl_diag_int"
+                       : t == ValueType::BOOL ? "mpl_diag_bool"
+                                              : "mpl_diag_str";
+      line(fn + "(" + quote(id) + ", " + flag(slot) + ", " + var(slot) + ");");
+    }
+    line("mpl_diag_stack();");
+    line("mpl_diag_end();");
+    depth--;
+    line("}");
+  }
+
+  // Declarations of all variables and their written flags
+  std::string locals() const {
+    std::string s;
+    for (int slot = 0; slot < symbols.size(); slot++) {
+      ValueType t = symbols.types[slot];
+      std::string type = t == ValueType::INT    ? "int32_t "
+                         : t == ValueType::BOOL ? "bool "
+                                                : "mpl_str *";
+      std::string zero = t == ValueType::INT    ? "0"
+                         : t == ValueType::BOOL ? "false"
+                                                : "&mpl_empty";
+      s += "  " + type + var(slot) + " = " + zero + ";\n";
+      s += "  bool " + flag(slot) + " = false;\n";
+    }
+    return s;
+  }
+
+private:
+  int strings = 0;
+  int depth = 1;
+  // Enclosing loops, whose depth tells their variables apart
+  int loops = 0;
+
+  static std::string var(int slot) { return "v" + std::to_string(slot); }
+  static std::string flag(int slot) { return "w" + std::to_string(slot); }
+  static std::string call(const char *fn, const std::string &l,
+                          const std::string &r) {
+    return std::string(fn) + "(" + l + ", " + r + ")";
+  }
+  std::string expr(const Parser::Opnd *o) {
+    const_cast<Parser::Opnd *>(o)->accept(this);
+    return result;
+  }
+  void line(const std::string &s) {
+    body += std::string(2 * depth, ' ') + s + "\n";
+  }
+  void store(int slot, const std::string &value) {
+    if (symbols.types[slot] == ValueType::STRING)
+      line("mpl_set(&" + var(slot) + ", " + value + ");");
+    else
+      line(var(slot) + " = " + value + ";");
+    line(flag(slot) + " = true;");
+  }
+};
+
+std::string translate(const Parser::Stmts *program,
+                      const Resolver::Symbols &symbols) {
+  CWalker cw(symbols);
+  const_cast<Parser::Stmts *>(program)->accept(&cw);
+  return std::string(RUNTIME) + "\n" + cw.literals + "\nint main(void) {\n" +
+         cw.locals() + cw.body + "  return mpl_status;\n}\n";
+}
+
+static bool endsWith(const std::string &s, const std::string &suffix) {
+  return s.size() >= suffix.size() &&
+         s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Quotes s for the shell
+static std::string shellQuote(const std::string &s) {
+  std::string o = "'";
+  for (char c : s)
+    o += c == '\'' ? std::string("'\\''") : std::string(1, c);
+  return o + "'";
+}
+
+bool build(std::string_view source, const std::string &output,
+           bool optimize) {
+  Parser::Program program;
+  Resolver::Symbols symbols;
+  if (!Compiler::analyze(source, &program, &symbols, optimize))
+    return false;
+  std::string c = translate(program.stmts, symbols);
+  if (endsWith(output, ".c")) {
+    std::ofstream out(output, std::ios::binary);
+    out << c;
+    if (!out) {
+      fprintf(stderr, "Failed to write file: %s\n", output.c_str());
+      return false;
+    }
+    return true;
+  }
+  char path[] = "/tmp/mini-pl-XXXXXX.c";
+  int fd = mkstemps(path, 2);
+  if (fd < 0 || write(fd, c.data(), c.size()) != (ssize_t)c.size()) {
+    fprintf(stderr, "Failed to write temporary C file\n");
+    if (fd >= 0) {
+      close(fd);
+      unlink(path);
+    }
+    return false;
+  }
+  close(fd);
+  const char *cc = getenv("CC");
+  std::string cmd = std::string(cc && *cc ? cc : "cc") +
+                    " -O2 -fwrapv -w -o " + shellQuote(output) + " " +
+                    shellQuote(path);
+  int status = system(cmd.c_str());
+  unlink(path);
+  if (status != 0) {
+    fprintf(stderr, "C compiler failed: %s\n", cmd.c_str());
+    return false;
+  }
+  return true;
+}
+
+} // namespace Aot
@@ -0,0 +1,27 @@
+#ifndef AOT_H_
+#define AOT_H_
+
+#include "parser.h"
+#include "resolver.h"
+#include <string>
+#include <string_view>
+
+// Ahead-of-time compilation: a checked program is translated to C, with
+// variables as typed locals of main and for loops as C loops, against a
+// small runtime for strings, print, read and assert diagnostics that is
+// emitted along with it. The system C compiler turns that into a standalone
+// executable whose output matches the VM.
+namespace Aot {
+
+std::string translate(const Parser::Stmts *program,
+                      const Resolver::Symbols &symbols);
+
+// Compiles source into an executable at output using $CC (default cc). If
+// output ends in ".c" only the C source is written. Errors are reported to
+// stderr; returns false if there were any.
+bool build(std::string_view source, const std::string &output,
+           bool optimize);
+
+} // namespace Aot
+
+#endif // AOT_H_
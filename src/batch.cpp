@@ -0,0 +1,112 @@
+#include "batch.h"
+#include "io.h"
+#include "pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+namespace Batch {
+
+namespace fs = std::filesystem;
+
+struct Job {
+  fs::path path;
+  std::string out;
+  std::string err;
+  int status = 0;
+  double millis = 0;
+};
+
+static bool readFile(const fs::path &path, std::string *contents) {
+  std::ifstream in(path, std::ios::in | std::ios::binary);
+  if (!in)
+    return false;
+  std::ostringstream ss;
+  ss << in.rdbuf();
+  *contents = ss.str();
+  return true;
+}
+
+static void runJob(Job *job, const Interpreter::Options &options) {
+  auto start = std::chrono::steady_clock::now();
+  IO::MappedFile source;
+  std::string input;
+  std::ostringstream out, err;
+  if (!source.open(job->path)) {
+    err << "Failed to read file: " << job->path.string() << "\n";
+    job->status = 1;
+  } else {
+    fs::path inputPath = job->path;
+    inputPath.replace_extension(".in");
+    readFile(inputPath, &input);
+    std::istringstream in(input);
+    IO::Redirect redirect(in, out, err);
+    try {
+      job->status = Interpreter::exitStatus(
+          Interpreter::interpret(source.text(), options));
+    } catch (std::exception &e) {
+      // An exception escaping the interpreter fails only this program
+      err << "Runtime error: " << e.what() << "\n";
+      job->status = 1;
+    }
+  }
+  job->out = out.str();
+  job->err = err.str();
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  job->millis = elapsed.count();
+}
+
+// Writes captured text so that the next header starts on a line of its own
+static void writeBlock(const std::string &s) {
+  fwrite(s.data(), 1, s.size(), stdout);
+  if (!s.empty() && s.back() != '\n')
+    putchar('\n');
+}
+
+int run(const std::string &dir, unsigned threads,
+        const Interpreter::Options &options) {
+  std::vector<Job> jobs;
+  std::error_code ec;
+  for (const fs::directory_entry &e : fs::directory_iterator(dir, ec))
+    if (e.path().extension() == ".mpl")
+      jobs.push_back(Job{e.path()});
+  if (ec) {
+    std::cerr << "Failed to read directory: " << dir << std::endl;
+    return -1;
+  }
+  std::sort(jobs.begin(), jobs.end(),
+            [](const Job &a, const Job &b) { return a.path < b.path; });
+
+  auto start = std::chrono::steady_clock::now();
+  Pool::parallelFor(jobs.size(), threads,
+                    [&](size_t i) { runJob(&jobs[i], options); });
+  std::chrono::duration<double, std::milli> wall =
+      std::chrono::steady_clock::now() - start;
+
+  int failed = 0;
+  double total = 0;
+  for (const Job &job : jobs) {
+    printf("=== %s exit:%d time:%.3fms\n", job.path.c_str(), job.status,
+           job.millis);
+    writeBlock(job.out);
+    if (!job.err.empty()) {
+      printf("--- stderr\n");
+      writeBlock(job.err);
+    }
+    failed += job.status != 0;
+    total += job.millis;
+  }
+  fflush(stdout);
+  fprintf(stderr,
+          "%zu programs, %d failed, %u threads, %.3fms wall, %.3fms total\n",
+          jobs.size(), failed, threads, wall.count(), total);
+  return failed;
+}
+
+} // namespace Batch
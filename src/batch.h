@@ -0,0 +1,21 @@
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include "interpreter.h"
+#include <string>
+
+// Runs many programs in one process
+namespace Batch {
+
+// Runs every .mpl file in dir on a pool of threads. A program reads its
+// input from the file of the same name with the extension .in, or gets
+// empty input if there is none. Output, diagnostics, exit status and run
+// time of each program are captured separately and printed to stdout in
+// file name order once all have finished. Returns the number of programs
+// that failed, or -1 if dir could not be read.
+int run(const std::string &dir, unsigned threads,
+        const Interpreter::Options &options);
+
+} // namespace Batch
+
+#endif // BATCH_H_
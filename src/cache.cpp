@@ -0,0 +1,393 @@
+#include "cache.h"
+#include "io.h"
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace Cache {
+
+using Runtime::Value;
+using Runtime::ValueType;
+
+// Bumped whenever the bytecode, what it computes or this layout changes.
+// 2: binary operators associate to the left
+// 3: build fingerprint in the header and the key
+static const uint32_t VERSION = 3;
+static const char MAGIC[4] = {'M', 'P', 'L', 'C'};
+
+// All fields are in host byte order; a file written with the other byte
+// order fails the version check
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+  uint64_t build;
+  // FNV-1a hash of everything after the header
+  uint64_t checksum;
+  uint32_t codeSize;
+  uint32_t lineRuns; // (length, line) pairs covering the code
+  uint32_t constants;
+  uint32_t slots; // entries of names and types
+  uint32_t maxStack;
+};
+
+static uint64_t fnv1a(const char *p, size_t n,
+                      uint64_t h = 0xcbf29ce484222325ull) {
+  for (size_t i = 0; i < n; i++) {
+    h ^= (uint8_t)p[i];
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+// Identifies the build: files written by another compiler or with another
+// instruction set are rejected even if VERSION was not bumped
+static uint64_t fingerprint() {
+#define F(name, operands) #name "/" #operands " "
+  static const char build[] = __VERSION__ " " OP_CODES(F);
+#undef F
+  static const uint64_t h = fnv1a(build, sizeof build - 1,
+                                  fnv1a((const char *)&VERSION, 4));
+  return h;
+}
+
+uint64_t key(std::string_view source, bool optimize) {
+  uint64_t h = fnv1a(source.data(), source.size(), fingerprint());
+  h = fnv1a(optimize ? "O" : "-", 1, h);
+  // 0 is reserved for accepting any source
+  return h ? h : 1;
+}
+
+std::string path(const std::string &dir, uint64_t key) {
+  char name[32];
+  snprintf(name, sizeof name, "%016llx.mplc", (unsigned long long)key);
+  return dir + "/" + name;
+}
+
+static void put(std::string *out, const void *p, size_t n) {
+  out->append((const char *)p, n);
+}
+
+static void putString(std::string *out, std::string_view s) {
+  uint32_t n = s.size();
+  put(out, &n, 4);
+  put(out, s.data(), n);
+}
+
+bool store(const Compiler::Chunk &chunk, uint64_t key,
+           const std::string &path) {
+  std::string payload;
+  put(&payload, chunk.code.data(), chunk.code.size());
+  // Consecutive bytes mostly share a line, so lines are stored as runs
+  uint32_t runs = 0;
+  for (size_t i = 0; i < chunk.lines.size();) {
+    size_t j = i;
+    while (j < chunk.lines.size() && chunk.lines[j] == chunk.lines[i])
+      j++;
+    int32_t run[2] = {(int32_t)(j - i), chunk.lines[i]};
+    put(&payload, run, 8);
+    runs++;
+    i = j;
+  }
+  for (const Value &c : chunk.constants)
+    putString(&payload, c.getString());
+  for (const std::string &name : chunk.names)
+    putString(&payload, name);
+  for (ValueType t : chunk.types)
+    payload.push_back((char)t);
+
+  Header h;
+  memcpy(h.magic, MAGIC, 4);
+  h.version = VERSION;
+  h.key = key;
+  h.build = fingerprint();
+  h.checksum = fnv1a(payload.data(), payload.size());
+  h.codeSize = chunk.code.size();
+  h.lineRuns = runs;
+  h.constants = chunk.constants.size();
+  h.slots = chunk.names.size();
+  h.maxStack = chunk.maxStack;
+
+  // Written under a unique name and renamed into place
+  std::string tmp = path + ".XXXXXX";
+  int fd = mkstemp(&tmp[0]);
+  if (fd < 0)
+    return false;
+  bool ok = write(fd, &h, sizeof h) == (ssize_t)sizeof h &&
+            write(fd, payload.data(), payload.size()) ==
+                (ssize_t)payload.size();
+  ok = fchmod(fd, 0644) == 0 && ok;
+  ok = close(fd) == 0 && ok;
+  ok = ok && rename(tmp.c_str(), path.c_str()) == 0;
+  if (!ok)
+    unlink(tmp.c_str());
+  return ok;
+}
+
+// Reads fields of the payload, failing once it runs past the end
+class Reader {
+public:
+  const char *p;
+  const char *end;
+  bool ok = true;
+
+  Reader(const char *begin, const char *e) : p(begin), end(e) {}
+
+  const char *take(size_t n) {
+    if (!ok || (size_t)(end - p) < n) {
+      ok = false;
+      return nullptr;
+    }
+    p += n;
+    return p - n;
+  }
+  uint32_t word() {
+    uint32_t w = 0;
+    if (const char *q = take(4))
+      memcpy(&w, q, 4);
+    return w;
+  }
+  std::string string() {
+    uint32_t n = word();
+    const char *q = take(n);
+    return q ? std::string(q, n) : std::string();
+  }
+};
+
+#define F(name, operands) operands,
+static const int OPERANDS[]{OP_CODES(F)};
+#undef F
+static const size_t OPCODES = sizeof OPERANDS / sizeof OPERANDS[0];
+
+// The VM trusts its bytecode: operands index slots and constants unchecked
+// and typed ops never look at tags. A loaded chunk is simulated on a stack
+// of types instead, which must never underflow or outgrow maxStack and must
+// agree wherever a jump meets other code.
+static bool verify(const Compiler::Chunk &chunk) {
+  using Compiler::OpCode;
+  const std::vector<uint8_t> &code = chunk.code;
+  for (ValueType t : chunk.types)
+    if (t > ValueType::STRING)
+      return false;
+
+  // Instruction boundaries and jump targets
+  std::vector<bool> start(code.size()), target(code.size());
+  for (size_t i = 0; i < code.size(); i += 1 + 4 * OPERANDS[code[i]]) {
+    if (code[i] >= OPCODES || code.size() - i < 1 + 4u * OPERANDS[code[i]])
+      return false;
+    start[i] = true;
+  }
+  auto jump = [&](size_t i) -> int64_t {
+    int64_t next = i + 9;
+    int64_t to = (OpCode)code[i] == OpCode::FOR_PREP
+                     ? next + chunk.read32(i + 5)
+                     : next - chunk.read32(i + 5);
+    return to >= 0 && to < (int64_t)code.size() && start[to] ? to : -1;
+  };
+  for (size_t i = 0; i < code.size(); i += 1 + 4 * OPERANDS[code[i]]) {
+    OpCode op = (OpCode)code[i];
+    if (op == OpCode::FOR_PREP || op == OpCode::FOR_LOOP) {
+      int64_t to = jump(i);
+      if (to < 0)
+        return false;
+      target[to] = true;
+    }
+  }
+
+  std::vector<ValueType> stack;
+  std::map<size_t, std::vector<ValueType>> joins;
+  auto join = [&](size_t at) {
+    auto [it, added] = joins.emplace(at, stack);
+    return added || it->second == stack;
+  };
+  auto pop = [&](ValueType t) {
+    if (stack.empty() || stack.back() != t)
+      return false;
+    stack.pop_back();
+    return true;
+  };
+  auto push = [&](ValueType t) {
+    stack.push_back(t);
+    return (int)stack.size() <= chunk.maxStack;
+  };
+  auto slot = [&](size_t i, ValueType *t) {
+    uint32_t s = chunk.read32(i + 1);
+    if (s >= chunk.types.size())
+      return false;
+    *t = chunk.types[s];
+    return true;
+  };
+  auto binary = [&](ValueType operand, ValueType result) {
+    return pop(operand) && pop(operand) && push(result);
+  };
+  const ValueType INT = ValueType::INT, BOOL = ValueType::BOOL,
+                  STRING = ValueType::STRING;
+
+  for (size_t i = 0; i < code.size(); i += 1 + 4 * OPERANDS[code[i]]) {
+    if (target[i] && !join(i))
+      return false;
+    ValueType t;
+    bool ok = true;
+    switch ((OpCode)code[i]) {
+    case OpCode::INT:
+      ok = push(INT);
+      break;
+    case OpCode::TRUE:
+    case OpCode::FALSE:
+      ok = push(BOOL);
+      break;
+    case OpCode::STRING:
+      ok = chunk.read32(i + 1) < chunk.constants.size() && push(STRING);
+      break;
+    case OpCode::GET:
+      ok = slot(i, &t) && push(t);
+      break;
+    case OpCode::SET:
+      ok = slot(i, &t) && pop(t);
+      break;
+    case OpCode::POP:
+      ok = !stack.empty();
+      if (ok)
+        stack.pop_back();
+      break;
+    case OpCode::ADD:
+    case OpCode::SUB:
+    case OpCode::MUL:
+    case OpCode::DIV:
+      ok = binary(INT, INT);
+      break;
+    case OpCode::CONCAT:
+      ok = binary(STRING, STRING);
+      break;
+    case OpCode::LESS_INT:
+    case OpCode::EQUAL_INT:
+      ok = binary(INT, BOOL);
+      break;
+    case OpCode::LESS_BOOL:
+    case OpCode::EQUAL_BOOL:
+    case OpCode::AND:
+      ok = binary(BOOL, BOOL);
+      break;
+    case OpCode::LESS_STRING:
+    case OpCode::EQUAL_STRING:
+      ok = binary(STRING, BOOL);
+      break;
+    case OpCode::NOT:
+      ok = pop(BOOL) && push(BOOL);
+      break;
+    case OpCode::PRINT_INT:
+      ok = pop(INT);
+      break;
+    case OpCode::PRINT_BOOL:
+    case OpCode::ASSERT:
+      ok = pop(BOOL);
+      break;
+    case OpCode::PRINT_STRING:
+      ok = pop(STRING);
+      break;
+    case OpCode::READ_INT:
+      ok = slot(i, &t) && t == INT;
+      break;
+    case OpCode::READ_BOOL:
+      ok = slot(i, &t) && t == BOOL;
+      break;
+    case OpCode::READ_STRING:
+      ok = slot(i, &t) && t == STRING;
+      break;
+    case OpCode::FOR_PREP:
+      // [from to] -> [to], the exit is taken with the same stack
+      ok = slot(i, &t) && t == INT && pop(INT) && pop(INT) && push(INT) &&
+           join(jump(i));
+      break;
+    case OpCode::FOR_LOOP:
+      ok = slot(i, &t) && t == INT && !stack.empty() &&
+           stack.back() == INT && join(jump(i));
+      break;
+    case OpCode::RETURN:
+      // The compiler emits only the final one
+      return i + 1 == code.size();
+    }
+    if (!ok)
+      return false;
+  }
+  // Ran past the end without a RETURN
+  return false;
+}
+
+static bool parse(const char *data, size_t size, uint64_t key,
+                  Compiler::Chunk *chunk) {
+  Header h;
+  if (size < sizeof h)
+    return false;
+  memcpy(&h, data, sizeof h);
+  if (memcmp(h.magic, MAGIC, 4) != 0 || h.version != VERSION ||
+      h.build != fingerprint() || (key && h.key != key) ||
+      h.checksum != fnv1a(data + sizeof h, size - sizeof h))
+    return false;
+  Reader r(data + sizeof h, data + size);
+  if (const char *code = r.take(h.codeSize))
+    chunk->code.assign(code, code + h.codeSize);
+  for (uint32_t i = 0; i < h.lineRuns && r.ok; i++) {
+    uint32_t length = r.word();
+    int32_t line = r.word();
+    if (length > h.codeSize - chunk->lines.size())
+      return false;
+    chunk->lines.insert(chunk->lines.end(), length, line);
+  }
+  if (chunk->lines.size() != h.codeSize)
+    return false;
+  for (uint32_t i = 0; i < h.constants && r.ok; i++)
+    chunk->constants.push_back(Value::string(r.string()));
+  for (uint32_t i = 0; i < h.slots && r.ok; i++)
+    chunk->names.push_back(r.string());
+  if (const char *types = r.take(h.slots))
+    for (uint32_t i = 0; i < h.slots; i++)
+      chunk->types.push_back((ValueType)types[i]);
+  chunk->maxStack = h.maxStack;
+  return r.ok && r.p == r.end && verify(*chunk);
+}
+
+bool load(const std::string &path, uint64_t key, Compiler::Chunk *chunk) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return false;
+  Compiler::Chunk loaded;
+  bool ok = parse((const char *)data, st.st_size, key, &loaded);
+  munmap(data, st.st_size);
+  if (ok)
+    *chunk = std::move(loaded);
+  return ok;
+}
+
+bool precompile(std::string_view source, const std::string &path,
+                bool optimize) {
+  Compiler::Chunk chunk;
+  {
+    Parser::Program program;
+    Resolver::Symbols symbols;
+    if (!Compiler::analyze(source, &program, &symbols, optimize))
+      return false;
+    Compiler::compile(program.stmts, symbols, &chunk);
+  }
+  if (!store(chunk, key(source, optimize), path)) {
+    IO::err() << "Failed to write file: " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+} // namespace Cache
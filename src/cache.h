@@ -0,0 +1,40 @@
+#ifndef CACHE_H_
+#define CACHE_H_
+
+#include "compiler.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Precompiled programs (.mplc files): the bytecode chunk of a program in a
+// versioned binary form, tagged with a hash of the source it was compiled
+// from so that a run can load it instead of scanning and parsing again.
+namespace Cache {
+
+// Identifies a source together with the options and the build it is
+// compiled with
+uint64_t key(std::string_view source, bool optimize);
+
+// Cache file of a source in a cache directory
+std::string path(const std::string &dir, uint64_t key);
+
+// Writes a chunk compiled from the source with the given key. The file is
+// replaced atomically, so concurrent writers and readers are safe. Returns
+// false if it could not be written.
+bool store(const Compiler::Chunk &chunk, uint64_t key,
+           const std::string &path);
+
+// Maps a cache file and loads its chunk. Fails if the file is missing,
+// damaged, written by another build, compiled from a source with a
+// different key, or if its bytecode would not be safe to run; a key of 0
+// accepts any source.
+bool load(const std::string &path, uint64_t key, Compiler::Chunk *chunk);
+
+// Compiles source and stores it at path. Errors are reported to IO::err();
+// returns false if there were any.
+bool precompile(std::string_view source, const std::string &path,
+                bool optimize);
+
+} // namespace Cache
+
+#endif // CACHE_H_
@@ -0,0 +1,243 @@
+#include "charscan.h"
+#include <cstdint>
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#define CHARSCAN_X86_64
+#endif
+
+namespace CharScan {
+
+// What ends a run
+enum class Kind {
+  SPACE, // any other character
+  IDENT,
+  DIGIT,
+  CHAR,  // the given character
+  QUOTE, // '"' or '\\'
+};
+
+typedef const char *(*ScanFn)(const char *p, const char *end, Kind kind,
+                              char c, int *lines);
+
+static bool stops(char ch, Kind kind, char c) {
+  switch (kind) {
+  case Kind::SPACE:
+    return !(ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n');
+  case Kind::IDENT:
+    return !(('a' <= (ch | 0x20) && (ch | 0x20) <= 'z') ||
+             ('0' <= ch && ch <= '9') || ch == '_');
+  case Kind::DIGIT:
+    return !('0' <= ch && ch <= '9');
+  case Kind::CHAR:
+    return ch == c;
+  case Kind::QUOTE:
+    return ch == '"' || ch == '\\';
+  }
+  return true;
+}
+
+static const char *scanScalar(const char *p, const char *end, Kind kind,
+                              char c, int *lines) {
+  for (; p < end && !stops(*p, kind, c); p++)
+    if (*p == '\n' && lines)
+      ++*lines;
+  return p;
+}
+
+#ifdef CHARSCAN_X86_64
+
+// Bytes of v within [lo, hi], by an unsigned compare of v - lo
+static __m128i inRange(__m128i v, char lo, char hi) {
+  __m128i d = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+  return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(hi - lo)), d);
+}
+
+static __m128i equal(__m128i v, char c) {
+  return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+}
+
+// One bit per byte of v that ends the run
+static uint32_t stopMask(__m128i v, Kind kind, char c) {
+  __m128i m;
+  switch (kind) {
+  case Kind::SPACE:
+    m = _mm_or_si128(_mm_or_si128(equal(v, ' '), equal(v, '\t')),
+                     _mm_or_si128(equal(v, '\r'), equal(v, '\n')));
+    return ~_mm_movemask_epi8(m) & 0xffff;
+  case Kind::IDENT:
+    m = _mm_or_si128(inRange(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z'),
+                     _mm_or_si128(inRange(v, '0', '9'), equal(v, '_')));
+    return ~_mm_movemask_epi8(m) & 0xffff;
+  case Kind::DIGIT:
+    return ~_mm_movemask_epi8(inRange(v, '0', '9')) & 0xffff;
+  case Kind::CHAR:
+    return _mm_movemask_epi8(equal(v, c));
+  case Kind::QUOTE:
+    return _mm_movemask_epi8(_mm_or_si128(equal(v, '"'), equal(v, '\\')));
+  }
+  return 1;
+}
+
+static const char *scanSse2(const char *p, const char *end, Kind kind,
+                            char c, int *lines) {
+  bool count = lines && kind != Kind::IDENT && kind != Kind::DIGIT;
+  for (; end - p >= 16; p += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    uint32_t stop = stopMask(v, kind, c);
+    uint32_t newlines = count ? _mm_movemask_epi8(equal(v, '\n')) : 0;
+    if (stop) {
+      int n = __builtin_ctz(stop);
+      if (count)
+        *lines += __builtin_popcount(newlines & ((1u << n) - 1));
+      return p + n;
+    }
+    if (count)
+      *lines += __builtin_popcount(newlines);
+  }
+  return scanScalar(p, end, kind, c, lines);
+}
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static __m256i inRange(__m256i v, char lo, char hi) {
+  __m256i d = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(hi - lo)), d);
+}
+
+AVX2 static __m256i equal(__m256i v, char c) {
+  return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));
+}
+
+AVX2 static uint32_t stopMask(__m256i v, Kind kind, char c) {
+  __m256i m;
+  switch (kind) {
+  case Kind::SPACE:
+    m = _mm256_or_si256(_mm256_or_si256(equal(v, ' '), equal(v, '\t')),
+                        _mm256_or_si256(equal(v, '\r'), equal(v, '\n')));
+    return ~(uint32_t)_mm256_movemask_epi8(m);
+  case Kind::IDENT:
+    m = _mm256_or_si256(
+        inRange(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z'),
+        _mm256_or_si256(inRange(v, '0', '9'), equal(v, '_')));
+    return ~(uint32_t)_mm256_movemask_epi8(m);
+  case Kind::DIGIT:
+    return ~(uint32_t)_mm256_movemask_epi8(inRange(v, '0', '9'));
+  case Kind::CHAR:
+    return _mm256_movemask_epi8(equal(v, c));
+  case Kind::QUOTE:
+    return _mm256_movemask_epi8(
+        _mm256_or_si256(equal(v, '"'), equal(v, '\\')));
+  }
+  return 1;
+}
+
+AVX2 static const char *scanAvx2(const char *p, const char *end, Kind kind,
+                                 char c, int *lines) {
+  bool count = lines && kind != Kind::IDENT && kind != Kind::DIGIT;
+  for (; end - p >= 32; p += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    uint32_t stop = stopMask(v, kind, c);
+    uint32_t newlines = count ? _mm256_movemask_epi8(equal(v, '\n')) : 0;
+    if (stop) {
+      int n = __builtin_ctz(stop);
+      if (count)
+        *lines += __builtin_popcount(newlines & ((1u << n) - 1));
+      return p + n;
+    }
+    if (count)
+      *lines += __builtin_popcount(newlines);
+  }
+  return scanSse2(p, end, kind, c, lines);
+}
+
+#undef AVX2
+
+#endif // CHARSCAN_X86_64
+
+const char *getName(Level level) {
+  switch (level) {
+  case Level::SCALAR:
+    return "scalar";
+  case Level::SSE2:
+    return "sse2";
+  case Level::AVX2:
+    return "avx2";
+  }
+  return "";
+}
+
+Level best() {
+#ifdef CHARSCAN_X86_64
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return Level::AVX2;
+  return Level::SSE2;
+#else
+  return Level::SCALAR;
+#endif
+}
+
+static ScanFn select(Level level) {
+  switch (level) {
+#ifdef CHARSCAN_X86_64
+  case Level::AVX2:
+    return scanAvx2;
+  case Level::SSE2:
+    return scanSse2;
+#endif
+  default:
+    return scanScalar;
+  }
+}
+
+static Level active = best();
+static ScanFn scan = select(active);
+
+Level current() { return active; }
+
+void use(Level level) {
+  if ((int)level > (int)best())
+    level = best();
+  active = level;
+  scan = select(level);
+}
+
+// Most runs in real programs are short: a space between tokens, a short
+// name. Their first bytes are checked one at a time, and only longer runs
+// are handed to the vector code.
+static const int SHORT_RUN = 8;
+
+static const char *run(const char *p, const char *end, Kind kind, char c,
+                       int *lines) {
+  const char *limit = end - p > SHORT_RUN ? p + SHORT_RUN : end;
+  for (; p < limit; p++) {
+    if (stops(*p, kind, c))
+      return p;
+    if (*p == '\n' && lines)
+      ++*lines;
+  }
+  return p < end ? scan(p, end, kind, c, lines) : p;
+}
+
+const char *skipSpace(const char *p, const char *end, int *lines) {
+  return run(p, end, Kind::SPACE, 0, lines);
+}
+
+const char *skipIdent(const char *p, const char *end) {
+  return run(p, end, Kind::IDENT, 0, nullptr);
+}
+
+const char *skipDigits(const char *p, const char *end) {
+  return run(p, end, Kind::DIGIT, 0, nullptr);
+}
+
+const char *find(const char *p, const char *end, char c, int *lines) {
+  return run(p, end, Kind::CHAR, c, lines);
+}
+
+const char *findQuote(const char *p, const char *end, int *lines) {
+  return run(p, end, Kind::QUOTE, 0, lines);
+}
+
+} // namespace CharScan
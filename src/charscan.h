@@ -0,0 +1,36 @@
+#ifndef CHARSCAN_H_
+#define CHARSCAN_H_
+
+// Character class runs for the scanner, found 16 (SSE2) or 32 (AVX2) bytes
+// at a time where the CPU allows. The widest supported level is picked at
+// startup; the scalar versions are used on other platforms and for the last
+// bytes of the input, which is never read past its end.
+namespace CharScan {
+
+enum class Level { SCALAR, SSE2, AVX2 };
+
+const char *getName(Level level);
+// Widest level the CPU supports
+Level best();
+Level current();
+// Switches to level, or to best() if the CPU does not support it. Meant
+// for benchmarks; not safe while other threads are scanning.
+void use(Level level);
+
+// Each function returns the first position in [p, end) that ends the run,
+// or end. Newlines passed over are added to *lines.
+
+// Spaces, tabs, carriage returns and newlines
+const char *skipSpace(const char *p, const char *end, int *lines);
+// Letters, digits and underscores
+const char *skipIdent(const char *p, const char *end);
+const char *skipDigits(const char *p, const char *end);
+// Up to the next c
+const char *find(const char *p, const char *end, char c, int *lines);
+// Up to the next '"' or '\\', which are the characters that matter inside a
+// string literal
+const char *findQuote(const char *p, const char *end, int *lines);
+
+} // namespace CharScan
+
+#endif // CHARSCAN_H_
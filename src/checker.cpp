@@ -0,0 +1,131 @@
+#include "checker.h"
+#include "io.h"
+#include <cstdio>
+#include <string>
+
+namespace Checker {
+
+using Runtime::ValueType;
+
+class CheckWalker : public Parser::ExprWalker {
+public:
+  const Resolver::Symbols &symbols;
+  bool hadError = false;
+
+  CheckWalker(const Resolver::Symbols &s) : symbols(s) {}
+
+  void visitOpnd(const Parser::Opnd *i) override {}
+  void visitInt(const Parser::Int *i) override {
+    long long n = 0;
+    for (int c = 0; c < i->value.length && n <= INT32_MAX; c++)
+      n = n * 10 + (i->value.start[c] - '0');
+    if (n > INT32_MAX)
+      error(i->value, "Integer literal out of range");
+    annotate(i, ValueType::INT);
+  }
+  void visitBool(const Parser::Bool *b) override {
+    annotate(b, ValueType::BOOL);
+  }
+  void visitString(const Parser::String *s) override {
+    annotate(s, ValueType::STRING);
+  }
+  void visitIdent(const Parser::Ident *i) override {
+    annotate(i, symbols.types[i->slot]);
+  }
+  void visitExpr(const Parser::Expr *e) override {}
+  void visitBinary(const Parser::Binary *b) override {
+    ValueType l = b->left->type;
+    ValueType r = b->right->type;
+    if (l != r)
+      error(b->op, "Operands have different types " + Runtime::getName(l) +
+                       " and " + Runtime::getName(r));
+    switch (b->op.type) {
+    case Scanner::TokenType::PLUS:
+      if (l != ValueType::INT && l != ValueType::STRING)
+        operatorError(b->op, l);
+      annotate(b, l);
+      break;
+    case Scanner::TokenType::MINUS:
+    case Scanner::TokenType::ASTERISK:
+    case Scanner::TokenType::SLASH:
+      if (l != ValueType::INT)
+        operatorError(b->op, l);
+      annotate(b, ValueType::INT);
+      break;
+    case Scanner::TokenType::AND:
+      if (l != ValueType::BOOL)
+        operatorError(b->op, l);
+      annotate(b, ValueType::BOOL);
+      break;
+    case Scanner::TokenType::LESS:
+    case Scanner::TokenType::EQUAL:
+      annotate(b, ValueType::BOOL);
+      break;
+    default:
+      error(b->op, "Unknown operator");
+    }
+  }
+  void visitUnary(const Parser::Unary *u) override {
+    if (u->right->type != ValueType::BOOL)
+      operatorError(u->op, u->right->type);
+    annotate(u, ValueType::BOOL);
+  }
+  void visitSingle(const Parser::Single *s) override {
+    annotate(s, s->right->type);
+  }
+  void visitStmt(const Parser::Stmt *s) override {}
+  void visitStmts(const Parser::Stmts *s) override {
+    for (Parser::TreeNode *n : s->stmts) {
+      n->accept(this);
+    }
+  }
+  void visitVar(const Parser::Var *v) override {
+    if (v->expr) {
+      walkExpr(v->expr);
+      expect(v->ident, v->expr, symbols.types[v->slot]);
+    }
+  }
+  void visitAssign(const Parser::Assign *a) override {
+    walkExpr(a->expr);
+    expect(a->ident, a->expr, symbols.types[a->slot]);
+  }
+  void visitFor(const Parser::For *f) override {
+    walkExpr(f->from);
+    expect(f->ident, f->from, ValueType::INT);
+    walkExpr(f->to);
+    expect(f->ident, f->to, ValueType::INT);
+    f->body->accept(this);
+  }
+  void visitRead(const Parser::Read *r) override {}
+  void visitPrint(const Parser::Print *p) override { walkExpr(p->expr); }
+  void visitAssert(const Parser::Assert *a) override {
+    walkExpr(a->expr);
+    expect(a->keyword, a->expr, ValueType::BOOL);
+  }
+
+private:
+  void annotate(const Parser::Opnd *o, ValueType t) {
+    const_cast<Parser::Opnd *>(o)->type = t;
+  }
+  void error(Scanner::Token t, std::string msg) {
+    IO::errorf("[line %d] Error at '%.*s': %s\n", t.line, t.length,
+               t.start, msg.c_str());
+    hadError = true;
+  }
+  void operatorError(Scanner::Token op, ValueType t) {
+    error(op, "Operator does not apply to " + Runtime::getName(t));
+  }
+  void expect(Scanner::Token t, const Parser::Expr *e, ValueType want) {
+    if (e->type != want)
+      error(t, "Expression has type " + Runtime::getName(e->type) +
+                   ", expected " + Runtime::getName(want));
+  }
+};
+
+bool check(Parser::Stmts *program, const Resolver::Symbols &symbols) {
+  CheckWalker cw(symbols);
+  program->accept(&cw);
+  return !cw.hadError;
+}
+
+} // namespace Checker
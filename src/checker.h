@@ -0,0 +1,17 @@
+#ifndef CHECKER_H_
+#define CHECKER_H_
+
+#include "parser.h"
+#include "resolver.h"
+
+namespace Checker {
+
+// Infers the type of every operand of a resolved program, stores it on the
+// node and checks it against the declarations and operators. Errors are
+// reported to stderr; returns false if there were any. Backends rely on the
+// annotations and do not check types themselves.
+bool check(Parser::Stmts *program, const Resolver::Symbols &symbols);
+
+} // namespace Checker
+
+#endif // CHECKER_H_
@@ -1,15 +1,56 @@
 #include "compiler.h"
+#include "charscan.h"
+#include "checker.h"
+#include "flat.h"
+#include "optimizer.h"
 #include "parser.h"
+#include "resolver.h"
 #include "scanner.h"
+#include "tokens.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
 
 namespace Compiler {
 
+#define F(name, operands) #name,
+static const char *OpName[]{OP_CODES(F)};
+#undef F
+
+#define F(name, operands) operands,
+static const int OpOperands[]{OP_CODES(F)};
+#undef F
+
+std::string getName(OpCode op) { return OpName[static_cast<int>(op)]; }
+
+void Chunk::write(uint8_t byte, int line) {
+  code.push_back(byte);
+  lines.push_back(line);
+}
+
+void Chunk::write32(uint32_t word, int line) {
+  for (int i = 0; i < 4; i++)
+    write((word >> (8 * i)) & 0xff, line);
+}
+
+uint32_t Chunk::read32(size_t offset) const {
+  return code[offset] | code[offset + 1] << 8 | code[offset + 2] << 16 |
+         (uint32_t)code[offset + 3] << 24;
+}
+
+void Chunk::patch32(size_t offset, uint32_t word) {
+  for (int i = 0; i < 4; i++)
+    code[offset + i] = (word >> (8 * i)) & 0xff;
+}
+
 // Runs only the scanner and prints to stdout
-void runScanner(const std::string source) {
-  Scanner::init(source);
+void runScanner(std::string_view source) {
+  Scanner::Scanner scanner;
+  Scanner::init(&scanner, source.data(), source.data() + source.size());
   int line = -1;
   for (;;) {
-    Scanner::Token token = Scanner::scanToken();
+    Scanner::Token token = Scanner::scanToken(&scanner);
     if (token.line != line) {
       printf("%4d ", token.line);
       line = token.line;
@@ -24,5 +65,316 @@ void runScanner(const std::string source) {
   }
 }
 
-void runParser(const std::string source) { Parser::parse(source); }
+// Prints the syntax tree. The optimized tree is only available for programs
+// that pass the checker.
+void runParser(std::string_view source, bool optimize) {
+  if (!optimize) {
+    Parser::parse(source);
+    return;
+  }
+  Parser::Program program;
+  Resolver::Symbols symbols;
+  if (analyze(source, &program, &symbols, true))
+    Parser::pprint(program.stmts);
+}
+
+// Emits bytecode for a checked program. Operand types come from the
+// checker's annotations, so every arithmetic, comparison and print op is
+// emitted in its type-specialized form.
+class CompileWalker : public Parser::ExprWalker {
+public:
+  Chunk *chunk;
+  const Resolver::Symbols &symbols;
+
+  CompileWalker(Chunk *c, const Resolver::Symbols &s) : symbols(s) {
+    chunk = c;
+  }
+
+  void visitOpnd(const Parser::Opnd *i) override {}
+  void visitInt(const Parser::Int *i) override {
+    line = i->value.line;
+    emit(OpCode::INT);
+    emit32((uint32_t)i->number());
+    push();
+  }
+  void visitBool(const Parser::Bool *b) override {
+    line = b->value.line;
+    emit(b->value.start[0] == 't' ? OpCode::TRUE : OpCode::FALSE);
+    push();
+  }
+  void visitString(const Parser::String *s) override {
+    line = s->value.line;
+    emitString(std::string(s->text));
+  }
+  void visitIdent(const Parser::Ident *i) override {
+    line = i->ident.line;
+    emit(OpCode::GET);
+    emit32(i->slot);
+    push();
+  }
+  void visitExpr(const Parser::Expr *e) override {}
+  void visitBinary(const Parser::Binary *b) override {
+    line = b->op.line;
+    Runtime::ValueType t = b->left->type;
+    switch (b->op.type) {
+    case Scanner::TokenType::PLUS:
+      emit(t == Runtime::ValueType::STRING ? OpCode::CONCAT : OpCode::ADD);
+      break;
+    case Scanner::TokenType::MINUS:
+      emit(OpCode::SUB);
+      break;
+    case Scanner::TokenType::ASTERISK:
+      emit(OpCode::MUL);
+      break;
+    case Scanner::TokenType::SLASH:
+      emit(OpCode::DIV);
+      break;
+    case Scanner::TokenType::AND:
+      emit(OpCode::AND);
+      break;
+    case Scanner::TokenType::LESS:
+      emit(typed(t, OpCode::LESS_INT, OpCode::LESS_BOOL, OpCode::LESS_STRING));
+      break;
+    case Scanner::TokenType::EQUAL:
+      emit(
+          typed(t, OpCode::EQUAL_INT, OpCode::EQUAL_BOOL, OpCode::EQUAL_STRING));
+      break;
+    default:
+      break;
+    }
+    pop();
+  }
+  void visitUnary(const Parser::Unary *u) override {
+    line = u->op.line;
+    emit(OpCode::NOT);
+  }
+  void visitSingle(const Parser::Single *s) override {}
+  void visitStmt(const Parser::Stmt *s) override {}
+  void visitStmts(const Parser::Stmts *s) override {
+    for (Parser::TreeNode *n : s->stmts) {
+      n->accept(this);
+    }
+  }
+  void visitVar(const Parser::Var *v) override {
+    line = v->ident.line;
+    if (v->expr)
+      walkExpr(v->expr);
+    else
+      emitZero(symbols.types[v->slot]);
+    emit(OpCode::SET);
+    emit32(v->slot);
+    pop();
+  }
+  void visitAssign(const Parser::Assign *a) override {
+    line = a->ident.line;
+    walkExpr(a->expr);
+    emit(OpCode::SET);
+    emit32(a->slot);
+    pop();
+  }
+  void visitFor(const Parser::For *f) override {
+    line = f->ident.line;
+    walkExpr(f->from);
+    walkExpr(f->to);
+    // The end value stays on the stack for the duration of the loop
+    line = f->ident.line;
+    emit(OpCode::FOR_PREP);
+    emit32(f->slot);
+    size_t exitJump = chunk->code.size();
+    emit32(0);
+    pop();
+    size_t bodyStart = chunk->code.size();
+    f->body->accept(this);
+    for (uint32_t k = 0; k < f->inductionCount; k++) {
+      const Parser::Induction &ind = f->inductions[k];
+      emit(OpCode::GET);
+      emit32(ind.slot);
+      push();
+      walkExpr(ind.step);
+      emit(OpCode::ADD);
+      pop();
+      emit(OpCode::SET);
+      emit32(ind.slot);
+      pop();
+    }
+    line = f->ident.line;
+    emit(OpCode::FOR_LOOP);
+    emit32(f->slot);
+    emit32(chunk->code.size() + 4 - bodyStart);
+    chunk->patch32(exitJump, chunk->code.size() - bodyStart);
+    emit(OpCode::POP);
+    pop();
+  }
+  void visitRead(const Parser::Read *r) override {
+    line = r->ident.line;
+    emit(typed(symbols.types[r->slot], OpCode::READ_INT, OpCode::READ_BOOL,
+               OpCode::READ_STRING));
+    emit32(r->slot);
+  }
+  void visitPrint(const Parser::Print *p) override {
+    line = p->keyword.line;
+    walkExpr(p->expr);
+    emit(typed(p->expr->type, OpCode::PRINT_INT, OpCode::PRINT_BOOL,
+               OpCode::PRINT_STRING));
+    pop();
+  }
+  void visitAssert(const Parser::Assert *a) override {
+    line = a->keyword.line;
+    walkExpr(a->expr);
+    emit(OpCode::ASSERT);
+    pop();
+  }
+
+  void finish() { emit(OpCode::RETURN); }
+
+private:
+  // Current depth of the value stack
+  int depth = 0;
+  int line = 1;
+
+  void push() {
+    if (++depth > chunk->maxStack)
+      chunk->maxStack = depth;
+  }
+  void pop() { depth--; }
+  OpCode typed(Runtime::ValueType t, OpCode i, OpCode b, OpCode s) {
+    return t == Runtime::ValueType::INT ? i
+           : t == Runtime::ValueType::BOOL ? b
+                                           : s;
+  }
+  void emit(OpCode op) { chunk->write((uint8_t)op, line); }
+  void emit32(uint32_t word) { chunk->write32(word, line); }
+  void emitString(std::string s) {
+    chunk->constants.push_back(Runtime::Value::string(std::move(s)));
+    emit(OpCode::STRING);
+    emit32(chunk->constants.size() - 1);
+    push();
+  }
+  void emitZero(Runtime::ValueType type) {
+    if (type == Runtime::ValueType::INT) {
+      emit(OpCode::INT);
+      emit32(0);
+      push();
+    } else if (type == Runtime::ValueType::BOOL) {
+      emit(OpCode::FALSE);
+      push();
+    } else {
+      emitString("");
+    }
+  }
+};
+
+void compile(const Parser::Stmts *program, const Resolver::Symbols &symbols,
+             Chunk *chunk) {
+  chunk->names = symbols.names;
+  chunk->types = symbols.types;
+  CompileWalker cw(chunk, symbols);
+  const_cast<Parser::Stmts *>(program)->accept(&cw);
+  cw.finish();
+}
+
+bool analyze(std::string_view source, Parser::Program *program,
+             Resolver::Symbols *symbols, bool optimize) {
+  return Parser::parseProgram(source, program) &&
+         analyze(program, symbols, optimize);
+}
+
+bool analyze(Parser::Program *program, Resolver::Symbols *symbols,
+             bool optimize) {
+  if (!Resolver::resolve(program->stmts, symbols) ||
+      !Checker::check(program->stmts, *symbols))
+    return false;
+  if (optimize)
+    Optimizer::optimize(program, symbols);
+  return true;
+}
+
+// Runs the scanner, parser and compiler and prints the bytecode to stdout
+void runCompiler(std::string_view source, bool optimize) {
+  Parser::Program program;
+  Resolver::Symbols symbols;
+  if (!analyze(source, &program, &symbols, optimize))
+    return;
+  Chunk chunk;
+  compile(program.stmts, symbols, &chunk);
+  disassemble(chunk);
+}
+
+void benchScanner(std::string_view source) {
+  CharScan::Level best = CharScan::best();
+  for (int l = 0; l <= (int)best; l++) {
+    CharScan::use((CharScan::Level)l);
+    size_t tokens = 0, bytes = 0;
+    int lines = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed;
+    // At least half a second of scanning for a stable figure
+    do {
+      Scanner::Scanner scanner;
+      Scanner::init(&scanner, source.data(), source.data() + source.size());
+      Scanner::Token token;
+      tokens = 0;
+      do {
+        token = Scanner::scanToken(&scanner);
+        tokens++;
+      } while (token.type != Scanner::TokenType::SCAN_EOF);
+      lines = token.line;
+      bytes += source.size();
+      elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed.count() < 0.5);
+    printf("%-8s %10.1f MB/s %12zu tokens %10d lines\n",
+           CharScan::getName((CharScan::Level)l),
+           bytes / elapsed.count() / 1e6, tokens, lines);
+  }
+  CharScan::use(best);
+  unsigned most = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned threads = 1;; threads = std::min(2 * threads, most)) {
+    Tokens::Buffer tokens;
+    size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed;
+    do {
+      Tokens::tokenize(source, &tokens, threads);
+      bytes += source.size();
+      elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed.count() < 0.5);
+    printf("%-8s %10.1f MB/s %12zu tokens %10u threads\n", "buffer",
+           bytes / elapsed.count() / 1e6, tokens.size(), threads);
+    if (threads == most)
+      break;
+  }
+}
+
+// Runs the scanner, parser and resolver and prints the flat tree to stdout
+void runFlat(std::string_view source, bool optimize) {
+  Parser::Program program;
+  Resolver::Symbols symbols;
+  Flat::Tree tree;
+  if (!analyze(source, &program, &symbols, optimize))
+    return;
+  Flat::lower(program, &tree);
+  Flat::dump(tree);
+}
+
+void disassemble(const Chunk &chunk) {
+  size_t offset = 0;
+  int line = -1;
+  while (offset < chunk.code.size()) {
+    OpCode op = (OpCode)chunk.code[offset];
+    printf("%04zu ", offset);
+    if (chunk.lines[offset] != line) {
+      line = chunk.lines[offset];
+      printf("%4d ", line);
+    } else {
+      printf("   | ");
+    }
+    printf("%-14s", getName(op).c_str());
+    int operands = OpOperands[(int)op];
+    for (int i = 0; i < operands; i++)
+      printf(" %u", chunk.read32(offset + 1 + 4 * i));
+    printf("\n");
+    offset += 1 + 4 * operands;
+  }
+}
+
 } // namespace Compiler
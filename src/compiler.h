@@ -1,12 +1,94 @@
 #ifndef COMPILER_H_
 #define COMPILER_H_
 
+#include "parser.h"
+#include "resolver.h"
+#include "value.h"
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace Compiler {
 
-void runScanner(const std::string source);
-void runParser(const std::string source);
+// Each opcode is followed by the given number of little-endian 32-bit
+// operands. Arithmetic and comparison ops are typed: the compiler knows the
+// operand types from the declarations, so the VM never checks tags.
+#define OP_CODES(F)                                                            \
+  F(INT, 1)          /* push immediate integer */                              \
+  F(TRUE, 0)                                                                   \
+  F(FALSE, 0)                                                                  \
+  F(STRING, 1)       /* push constant */                                       \
+  F(GET, 1)          /* push variable slot */                                  \
+  F(SET, 1)          /* pop into variable slot */                              \
+  F(POP, 0)                                                                    \
+  F(ADD, 0)                                                                    \
+  F(SUB, 0)                                                                    \
+  F(MUL, 0)                                                                    \
+  F(DIV, 0)                                                                    \
+  F(CONCAT, 0)                                                                 \
+  F(LESS_INT, 0)                                                               \
+  F(LESS_BOOL, 0)                                                              \
+  F(LESS_STRING, 0)                                                            \
+  F(EQUAL_INT, 0)                                                              \
+  F(EQUAL_BOOL, 0)                                                             \
+  F(EQUAL_STRING, 0)                                                           \
+  F(AND, 0)                                                                    \
+  F(NOT, 0)                                                                    \
+  F(PRINT_INT, 0)                                                              \
+  F(PRINT_BOOL, 0)                                                             \
+  F(PRINT_STRING, 0)                                                           \
+  F(READ_INT, 1)     /* read into variable slot */                             \
+  F(READ_BOOL, 1)                                                              \
+  F(READ_STRING, 1)                                                            \
+  F(ASSERT, 0)       /* pop, dump state if false */                            \
+  F(FOR_PREP, 2)     /* slot, exit: [from to] -> [to], skip loop if empty */   \
+  F(FOR_LOOP, 2)     /* slot, body: increment, jump back while <= to */        \
+  F(RETURN, 0)
+
+#define F(name, operands) name,
+enum class OpCode : uint8_t { OP_CODES(F) };
+#undef F
+
+std::string getName(OpCode op);
+
+struct Chunk {
+  std::vector<uint8_t> code;
+  std::vector<int> lines;
+  std::vector<Runtime::Value> constants;
+  // Variable names by slot, for diagnostics
+  std::vector<std::string> names;
+  std::vector<Runtime::ValueType> types;
+  int maxStack = 0;
+
+  void write(uint8_t byte, int line);
+  void write32(uint32_t word, int line);
+  uint32_t read32(size_t offset) const;
+  void patch32(size_t offset, uint32_t word);
+};
+
+void runScanner(std::string_view source);
+// Scans source repeatedly at each vector level the CPU supports and prints
+// the throughput
+void benchScanner(std::string_view source);
+void runParser(std::string_view source, bool optimize);
+void runCompiler(std::string_view source, bool optimize);
+void runFlat(std::string_view source, bool optimize);
+
+// Runs the front end: parses, resolves and type checks source, then runs the
+// optimizer if asked to. Errors are reported to IO::err(); returns false if
+// there were any.
+bool analyze(std::string_view source, Parser::Program *program,
+             Resolver::Symbols *symbols, bool optimize);
+// The same for a program that has already been parsed, such as one
+// statement of a Parser::Stream
+bool analyze(Parser::Program *program, Resolver::Symbols *symbols,
+             bool optimize);
+
+// Lowers a checked program to bytecode
+void compile(const Parser::Stmts *program, const Resolver::Symbols &symbols,
+             Chunk *chunk);
+void disassemble(const Chunk &chunk);
 
 } // namespace Compiler
 
@@ -0,0 +1,367 @@
+#include "flat.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace Flat {
+
+int Tree::line(uint32_t offset) const {
+  if (newlines.empty()) {
+    newlines.push_back(0);
+    for (uint32_t i = 0; i < source.size(); i++)
+      if (source[i] == '\n')
+        newlines.push_back(i + 1);
+  }
+  return std::upper_bound(newlines.begin(), newlines.end(), offset) -
+         newlines.begin();
+}
+
+size_t Tree::nodes() const {
+  size_t n = 0;
+  for (int k = 1; k < (int)Kind::COUNT; k++)
+    n += offset[k].size();
+  return n;
+}
+
+template <typename T> static size_t bytesOf(const std::vector<T> &v) {
+  return v.size() * sizeof(T);
+}
+
+size_t Tree::bytes() const {
+  size_t n = bytesOf(intValue) + bytesOf(boolValue) + bytesOf(stringLength) +
+             bytesOf(stringValue) +
+             bytesOf(identSlot) + bytesOf(binaryOp) + bytesOf(binaryType) +
+             bytesOf(binaryLeft) +
+             bytesOf(binaryRight) + bytesOf(unaryOp) + bytesOf(unaryRight) +
+             bytesOf(varSlot) + bytesOf(varInit) + bytesOf(assignSlot) +
+             bytesOf(assignExpr) + bytesOf(forSlot) + bytesOf(forFrom) +
+             bytesOf(forTo) + bytesOf(forBody) + bytesOf(forInductions) +
+             bytesOf(inductionSlot) + bytesOf(inductionStep) +
+             bytesOf(readSlot) +
+             bytesOf(printExpr) + bytesOf(printType) + bytesOf(assertExpr) + bytesOf(stmts);
+  for (int k = 1; k < (int)Kind::COUNT; k++)
+    n += bytesOf(offset[k]);
+  return n + extra.size();
+}
+
+void Walker::walk(Ref r) {
+  uint32_t i = index(r);
+  switch (kind(r)) {
+  case Kind::INT:
+    visitInt(i);
+    break;
+  case Kind::BOOL:
+    visitBool(i);
+    break;
+  case Kind::STRING:
+    visitString(i);
+    break;
+  case Kind::IDENT:
+    visitIdent(i);
+    break;
+  case Kind::BINARY:
+    visitBinary(i);
+    break;
+  case Kind::UNARY:
+    visitUnary(i);
+    break;
+  case Kind::VAR:
+    visitVar(i);
+    break;
+  case Kind::ASSIGN:
+    visitAssign(i);
+    break;
+  case Kind::FOR:
+    visitFor(i);
+    break;
+  case Kind::READ:
+    visitRead(i);
+    break;
+  case Kind::PRINT:
+    visitPrint(i);
+    break;
+  case Kind::ASSERT:
+    visitAssert(i);
+    break;
+  case Kind::NONE:
+  case Kind::COUNT:
+    break;
+  }
+}
+
+void Walker::walkExpr(Ref root) {
+  size_t base = order.size();
+  order.push_back({root, false});
+  while (order.size() > base) {
+    Ref r = order.back().first;
+    Kind k = kind(r);
+    if (order.back().second || (k != Kind::BINARY && k != Kind::UNARY)) {
+      order.pop_back();
+      walk(r);
+      continue;
+    }
+    order.back().second = true;
+    if (k == Kind::BINARY) {
+      order.push_back({tree.binaryRight[index(r)], false});
+      order.push_back({tree.binaryLeft[index(r)], false});
+    } else {
+      order.push_back({tree.unaryRight[index(r)], false});
+    }
+  }
+}
+
+// Builds the flat tree from the pointer tree. Expressions push their node on
+// results; statements are collected into the list being built.
+class LowerWalker : public Parser::ExprWalker {
+public:
+  Tree *tree;
+  std::vector<Ref> results;
+  std::vector<Ref> *list = nullptr;
+
+  LowerWalker(Tree *t) { tree = t; }
+
+  void visitOpnd(const Parser::Opnd *i) override { results.push_back(NONE); }
+  void visitInt(const Parser::Int *i) override {
+    results.push_back(node(Kind::INT, i->value));
+    tree->intValue.push_back(i->number());
+  }
+  void visitBool(const Parser::Bool *b) override {
+    results.push_back(node(Kind::BOOL, b->value));
+    tree->boolValue.push_back(b->value.start[0] == 't');
+  }
+  void visitString(const Parser::String *s) override {
+    results.push_back(node(Kind::STRING, s->value));
+    tree->stringLength.push_back(s->value.length);
+    uint32_t text = offsetOf(s->text.data(), s->text.size());
+    tree->stringValue.push_back({text, text + (uint32_t)s->text.size()});
+  }
+  void visitIdent(const Parser::Ident *i) override {
+    results.push_back(node(Kind::IDENT, i->ident));
+    tree->identSlot.push_back(i->slot);
+  }
+  void visitExpr(const Parser::Expr *e) override { results.push_back(NONE); }
+  void visitBinary(const Parser::Binary *b) override {
+    Ref right = take();
+    Ref left = take();
+    results.push_back(node(Kind::BINARY, b->op));
+    tree->binaryOp.push_back((uint8_t)b->op.type);
+    tree->binaryType.push_back((uint8_t)b->left->type);
+    tree->binaryLeft.push_back(left);
+    tree->binaryRight.push_back(right);
+  }
+  void visitUnary(const Parser::Unary *u) override {
+    Ref right = take();
+    results.push_back(node(Kind::UNARY, u->op));
+    tree->unaryOp.push_back((uint8_t)u->op.type);
+    tree->unaryRight.push_back(right);
+  }
+  // Parenthesized operands have no node of their own
+  void visitSingle(const Parser::Single *s) override {}
+  void visitStmt(const Parser::Stmt *s) override {}
+  void visitStmts(const Parser::Stmts *s) override {
+    std::vector<Ref> *outer = list;
+    std::vector<Ref> stmts;
+    list = &stmts;
+    for (Parser::TreeNode *n : s->stmts)
+      n->accept(this);
+    list = outer;
+    // Nested bodies were appended while lowering, this list goes after them
+    Range r{(uint32_t)tree->stmts.size(), 0};
+    tree->stmts.insert(tree->stmts.end(), stmts.begin(), stmts.end());
+    r.end = tree->stmts.size();
+    body = r;
+  }
+  void visitVar(const Parser::Var *v) override {
+    Ref init = NONE;
+    if (v->expr)
+      init = lower(v->expr);
+    list->push_back(node(Kind::VAR, v->ident));
+    tree->varSlot.push_back(v->slot);
+    tree->varInit.push_back(init);
+  }
+  void visitAssign(const Parser::Assign *a) override {
+    Ref expr = lower(a->expr);
+    list->push_back(node(Kind::ASSIGN, a->ident));
+    tree->assignSlot.push_back(a->slot);
+    tree->assignExpr.push_back(expr);
+  }
+  void visitFor(const Parser::For *f) override {
+    Ref from = lower(f->from);
+    Ref to = lower(f->to);
+    f->body->accept(this);
+    Range inductions{(uint32_t)tree->inductionSlot.size(), 0};
+    for (uint32_t k = 0; k < f->inductionCount; k++) {
+      Ref step = lower(f->inductions[k].step);
+      tree->inductionSlot.push_back(f->inductions[k].slot);
+      tree->inductionStep.push_back(step);
+    }
+    inductions.end = tree->inductionSlot.size();
+    list->push_back(node(Kind::FOR, f->ident));
+    tree->forSlot.push_back(f->slot);
+    tree->forFrom.push_back(from);
+    tree->forTo.push_back(to);
+    tree->forBody.push_back(body);
+    tree->forInductions.push_back(inductions);
+  }
+  void visitRead(const Parser::Read *r) override {
+    list->push_back(node(Kind::READ, r->ident));
+    tree->readSlot.push_back(r->slot);
+  }
+  void visitPrint(const Parser::Print *p) override {
+    Ref expr = lower(p->expr);
+    list->push_back(node(Kind::PRINT, p->keyword));
+    tree->printExpr.push_back(expr);
+    tree->printType.push_back((uint8_t)p->expr->type);
+  }
+  void visitAssert(const Parser::Assert *a) override {
+    Ref expr = lower(a->expr);
+    list->push_back(node(Kind::ASSERT, a->keyword));
+    tree->assertExpr.push_back(expr);
+  }
+
+  Range body{0, 0};
+
+private:
+  Ref take() {
+    Ref r = results.back();
+    results.pop_back();
+    return r;
+  }
+  Ref lower(Parser::Opnd *e) {
+    walkExpr(e);
+    return take();
+  }
+  Ref node(Kind k, Scanner::Token t) {
+    std::vector<uint32_t> &offsets = tree->offset[(int)k];
+    offsets.push_back(offsetOf(t.start, t.length));
+    return makeRef(k, offsets.size() - 1);
+  }
+  // Literals made by the optimizer and decoded string literals do not point
+  // into the source; their text is appended to the tree's extra text
+  uint32_t offsetOf(const char *start, size_t length) {
+    const std::string_view &source = tree->source;
+    if (start >= source.data() && start < source.data() + source.size())
+      return start - source.data();
+    tree->extra.append(start, length);
+    return source.size() + tree->extra.size() - length;
+  }
+};
+
+void lower(const Parser::Program &program, Tree *tree) {
+  tree->source = std::string_view(program.source, program.length);
+  LowerWalker lw(tree);
+  program.stmts->accept(&lw);
+  tree->program = lw.body;
+}
+
+class DumpWalker : public Walker {
+public:
+  DumpWalker(const Tree &t) : Walker(t) {}
+
+  void visitInt(uint32_t i) override { printf("%d", tree.intValue[i]); }
+  void visitBool(uint32_t i) override {
+    printf(tree.boolValue[i] ? "true" : "false");
+  }
+  void visitString(uint32_t i) override {
+    std::string_view s = tree.stringToken(i);
+    printf("%.*s", (int)s.size(), s.data());
+  }
+  void visitIdent(uint32_t i) override { printf("$%u", tree.identSlot[i]); }
+  void visitBinary(uint32_t i) override { expr(makeRef(Kind::BINARY, i)); }
+  void visitUnary(uint32_t i) override { expr(makeRef(Kind::UNARY, i)); }
+  void visitVar(uint32_t i) override {
+    stmt(Kind::VAR, i);
+    printf("var $%u", tree.varSlot[i]);
+    if (tree.varInit[i] != NONE) {
+      printf(" := ");
+      walk(tree.varInit[i]);
+    }
+    printf("\n");
+  }
+  void visitAssign(uint32_t i) override {
+    stmt(Kind::ASSIGN, i);
+    printf("$%u := ", tree.assignSlot[i]);
+    walk(tree.assignExpr[i]);
+    printf("\n");
+  }
+  void visitFor(uint32_t i) override {
+    stmt(Kind::FOR, i);
+    printf("for $%u in ", tree.forSlot[i]);
+    walk(tree.forFrom[i]);
+    printf(" .. ");
+    walk(tree.forTo[i]);
+    printf(" [%u, %u)\n", tree.forBody[i].begin, tree.forBody[i].end);
+    depth++;
+    walk(tree.forBody[i]);
+    Range inductions = tree.forInductions[i];
+    for (uint32_t k = inductions.begin; k < inductions.end; k++) {
+      printf("%4s %*s$%u += ", "", 2 * depth, "", tree.inductionSlot[k]);
+      walk(tree.inductionStep[k]);
+      printf("\n");
+    }
+    depth--;
+  }
+  void visitRead(uint32_t i) override {
+    stmt(Kind::READ, i);
+    printf("read $%u\n", tree.readSlot[i]);
+  }
+  void visitPrint(uint32_t i) override {
+    stmt(Kind::PRINT, i);
+    printf("print ");
+    walk(tree.printExpr[i]);
+    printf("\n");
+  }
+  void visitAssert(uint32_t i) override {
+    stmt(Kind::ASSERT, i);
+    printf("assert ");
+    walk(tree.assertExpr[i]);
+    printf("\n");
+  }
+
+private:
+  int depth = 0;
+
+  void stmt(Kind k, uint32_t i) {
+    printf("%4d %*s", tree.line(tree.offset[(int)k][i]), 2 * depth, "");
+  }
+
+  // Prints an expression from a stack of what is left to print, a node or
+  // a piece of text, rather than by recursion
+  void expr(Ref root) {
+    std::vector<std::pair<Ref, std::string>> todo{{root, ""}};
+    while (!todo.empty()) {
+      auto [r, text] = todo.back();
+      todo.pop_back();
+      uint32_t i = index(r);
+      if (!text.empty()) {
+        printf("%s", text.c_str());
+      } else if (kind(r) == Kind::BINARY) {
+        auto op = (Scanner::TokenType)tree.binaryOp[i];
+        todo.push_back({NONE, ")"});
+        todo.push_back({tree.binaryRight[i], ""});
+        todo.push_back({NONE, " "});
+        todo.push_back({NONE, Scanner::getLexeme(op)});
+        todo.push_back({NONE, " "});
+        todo.push_back({tree.binaryLeft[i], ""});
+        todo.push_back({NONE, "("});
+      } else if (kind(r) == Kind::UNARY) {
+        auto op = (Scanner::TokenType)tree.unaryOp[i];
+        todo.push_back({NONE, ")"});
+        todo.push_back({tree.unaryRight[i], ""});
+        todo.push_back({NONE, " "});
+        todo.push_back({NONE, Scanner::getLexeme(op)});
+        todo.push_back({NONE, "("});
+      } else {
+        walk(r);
+      }
+    }
+  }
+};
+
+void dump(const Tree &tree) {
+  printf("%zu nodes, %zu statements, %zu bytes\n", tree.nodes(),
+         tree.stmts.size(), tree.bytes());
+  DumpWalker dw(tree);
+  dw.walk(tree.program);
+}
+
+} // namespace Flat
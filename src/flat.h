@@ -0,0 +1,161 @@
+#ifndef FLAT_H_
+#define FLAT_H_
+
+#include "parser.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Compact structure-of-arrays form of a resolved program. A node is a 32-bit
+// reference holding its kind in the top 4 bits and an index into the arrays
+// of that kind in the low 28. There are no vtables or token copies; every
+// node keeps only its operator, children or slot, plus the source offset of
+// its first token.
+namespace Flat {
+
+enum class Kind : uint8_t {
+  NONE,
+  INT,
+  BOOL,
+  STRING,
+  IDENT,
+  BINARY,
+  UNARY,
+  VAR,
+  ASSIGN,
+  FOR,
+  READ,
+  PRINT,
+  ASSERT,
+  COUNT
+};
+
+typedef uint32_t Ref;
+const Ref NONE = 0;
+
+inline Ref makeRef(Kind k, uint32_t index) {
+  return (uint32_t)k << 28 | index;
+}
+inline Kind kind(Ref r) { return (Kind)(r >> 28); }
+inline uint32_t index(Ref r) { return r & 0x0fffffff; }
+
+// Half-open range of Tree::stmts
+struct Range {
+  uint32_t begin;
+  uint32_t end;
+};
+
+class Tree {
+public:
+  // Source text of the program, which is not copied: like the
+  // Parser::Program it was lowered from, the tree has to be outlived by it.
+  // Offsets point into it.
+  std::string_view source;
+  // Text the source does not hold: literals made by the optimizer and
+  // string literals with their escapes decoded. Offsets from source.size()
+  // on point into it.
+  std::string extra;
+
+  std::vector<int32_t> intValue;
+  std::vector<uint8_t> boolValue;
+  std::vector<uint32_t> stringLength; // including the quotes
+  std::vector<Range> stringValue;       // offsets, escapes decoded
+  std::vector<uint32_t> identSlot;
+  std::vector<uint8_t> binaryOp;   // Scanner::TokenType
+  std::vector<uint8_t> binaryType; // Runtime::ValueType of the operands
+  std::vector<Ref> binaryLeft;
+  std::vector<Ref> binaryRight;
+  std::vector<uint8_t> unaryOp;
+  std::vector<Ref> unaryRight;
+  std::vector<uint32_t> varSlot;
+  std::vector<Ref> varInit; // NONE if the variable has no initializer
+  std::vector<uint32_t> assignSlot;
+  std::vector<Ref> assignExpr;
+  std::vector<uint32_t> forSlot;
+  std::vector<Ref> forFrom;
+  std::vector<Ref> forTo;
+  std::vector<Range> forBody;
+  std::vector<Range> forInductions; // of inductionSlot and inductionStep
+  std::vector<uint32_t> inductionSlot;
+  std::vector<Ref> inductionStep;
+  std::vector<uint32_t> readSlot;
+  std::vector<Ref> printExpr;
+  std::vector<uint8_t> printType;
+  std::vector<Ref> assertExpr;
+  // Source offset of the first token of each node, by kind
+  std::vector<uint32_t> offset[(int)Kind::COUNT];
+
+  // Statement lists; the statements of each body are contiguous
+  std::vector<Ref> stmts;
+  Range program;
+
+  uint32_t offsetOf(Ref r) const { return offset[(int)kind(r)][index(r)]; }
+  // Line number of a source offset, from a newline index built on first use
+  int line(uint32_t offset) const;
+  // length characters at offset, from the source or from extra
+  std::string_view text(uint32_t offset, uint32_t length) const {
+    if (offset < source.size())
+      return source.substr(offset, length);
+    return std::string_view(extra).substr(offset - source.size(), length);
+  }
+  // A string literal as written, with its quotes
+  std::string_view stringToken(uint32_t i) const {
+    return text(offset[(int)Kind::STRING][i], stringLength[i]);
+  }
+  std::string_view stringText(uint32_t i) const {
+    return text(stringValue[i].begin,
+                stringValue[i].end - stringValue[i].begin);
+  }
+  size_t nodes() const;
+  size_t bytes() const;
+
+private:
+  mutable std::vector<uint32_t> newlines;
+};
+
+// Lowers a checked program
+void lower(const Parser::Program &program, Tree *tree);
+
+// Visits nodes by kind. visitX receives the index of the node in the arrays
+// of its kind.
+class Walker {
+public:
+  const Tree &tree;
+  Walker(const Tree &t) : tree(t) {}
+  virtual ~Walker() = default;
+
+  void walk(Ref r);
+  void walk(Range r) {
+    for (uint32_t i = r.begin; i < r.end; i++)
+      walk(tree.stmts[i]);
+  }
+  // Walks an expression in post-order with an explicit stack: visitBinary
+  // and visitUnary are called once their operands have been walked
+  void walkExpr(Ref r);
+
+  virtual void visitInt(uint32_t i) = 0;
+  virtual void visitBool(uint32_t i) = 0;
+  virtual void visitString(uint32_t i) = 0;
+  virtual void visitIdent(uint32_t i) = 0;
+  virtual void visitBinary(uint32_t i) = 0;
+  virtual void visitUnary(uint32_t i) = 0;
+  virtual void visitVar(uint32_t i) = 0;
+  virtual void visitAssign(uint32_t i) = 0;
+  virtual void visitFor(uint32_t i) = 0;
+  virtual void visitRead(uint32_t i) = 0;
+  virtual void visitPrint(uint32_t i) = 0;
+  virtual void visitAssert(uint32_t i) = 0;
+
+private:
+  // Nodes of walkExpr still to visit, and whether their operands have been
+  std::vector<std::pair<Ref, bool>> order;
+};
+
+// Prints node counts and memory use followed by the tree
+void dump(const Tree &tree);
+
+} // namespace Flat
+
+#endif // FLAT_H_
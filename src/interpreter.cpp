@@ -1,370 +1,529 @@
 #include "interpreter.h"
+#include "cache.h"
 #include "compiler.h"
+#include "flat.h"
+#include "io.h"
+#include "memory.h"
+#include "ops.h"
 #include "parser.h"
+#include "resolver.h"
 #include "scanner.h"
-#include <functional>
+#include "vm.h"
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
 #include <map>
-#include <stack>
+#include <unordered_map>
+#include <vector>
 #include <string>
 
 namespace Interpreter {
 
-void error(std::string msg) {
-  std::cerr << msg << std::endl;
-  throw;
-}
+using Runtime::Value;
+using Runtime::ValueType;
 
-class Variable {
-public:
-  Scanner::TokenType type;
-  bool constant;
-  int int_value;
-  bool bool_value;
-  std::string string_value;
-  void update(int i) {
-    if (constant)
-      error("Tried to write to constant variable");
-    int_value = i;
-    string_value = std::to_string(i);
-  }
-  void update(bool b) {
-    if (constant)
-      error("Tried to write to constant variable");
-    bool_value = b;
-    string_value = b ? "true" : "false";
-  }
-  void update(std::string s) {
-    if (constant)
-      error("Tried to write to constant variable");
-    if (type == Scanner::TokenType::INT)
-      update(std::stoi(s));
-    if (type == Scanner::TokenType::BOOL) {
-      update(s[0] == 't');
-    } else
-      string_value = s;
-  }
-  void set(Scanner::TokenType t, std::string s) {
-    constant = false;
-    if (t == Scanner::TokenType::INT || t == Scanner::TokenType::INTEGER_LIT) {
-      type = Scanner::TokenType::INT;
-      this->update(std::stoi(s));
-    } else if (t == Scanner::TokenType::BOOL ||
-               t == Scanner::TokenType::BOOLEAN_LIT) {
-      type = Scanner::TokenType::BOOL;
-      this->update(s[0] == 't');
-    } else if (t == Scanner::TokenType::STRING) {
-      type = Scanner::TokenType::STRING;
-      this->update(s);
-    } else if (t == Scanner::TokenType::STRING_LIT) {
-      // strip ""
-      type = Scanner::TokenType::STRING;
-      this->update(s.substr(1, s.length() - 2));
-    } else
-      error("Can not set variable of type:" + Scanner::getName(t));
-  }
-  void set(Scanner::TokenType t) {
-    constant = false;
-    type = t;
-    if (t == Scanner::TokenType::INT || t == Scanner::TokenType::INTEGER_LIT) {
-      this->update(0);
-    } else if (t == Scanner::TokenType::BOOL ||
-               t == Scanner::TokenType::BOOLEAN_LIT) {
-      this->update(false);
-    } else if (t == Scanner::TokenType::STRING ||
-               t == Scanner::TokenType::STRING_LIT) {
-      this->update("");
-    } else
-      error("Can not set variable of type:" + Scanner::getName(t));
-  }
-  int getInt() { return int_value; }
-  bool getBool() { return bool_value; }
-  std::string getString() { return string_value; }
+// Runtime error of the tree walkers, reported by interpret. Line 0 is for
+// errors of the interpreter itself, which are not tied to the program.
+struct RuntimeError {
+  int line;
+  std::string message;
 };
 
-std::map<std::string, Variable *> varMap;
-std::stack<Variable *> varStack;
-
-std::string toStr(Scanner::Token t) {
-  std::string s = "";
-  for (int i = 0; i < t.length; i++)
-    s = s + t.start[i];
-  return s;
+[[noreturn]] static void error(std::string msg) {
+  throw RuntimeError{0, "Internal error: " + msg};
 }
 
-std::map<std::string, std::function<Variable *(Variable *, Variable *)>>
-    opMap{};
-void init() {
-  opMap.emplace("+", [](Variable *l, Variable *r) {
-    Variable *n = new Variable();
-    n->set(l->type);
-    if (l->type == Scanner::TokenType::INT)
-      n->update(l->getInt() + r->getInt());
-    else
-      n->update(l->getString() + r->getString());
-    return n;
-  });
-  opMap.emplace("-", [](Variable *l, Variable *r) {
-    Variable *n = new Variable();
-    n->set(l->type);
-    n->update(l->getInt() - r->getInt());
-    return n;
-  });
-  opMap.emplace("*", [](Variable *l, Variable *r) {
-    Variable *n = new Variable();
-    n->set(l->type);
-    n->update(l->getInt() * r->getInt());
-    return n;
-  });
-  opMap.emplace("/", [](Variable *l, Variable *r) {
-    Variable *n = new Variable();
-    n->set(l->type);
-    n->update(l->getInt() / r->getInt());
-    return n;
-  });
-  opMap.emplace("&", [](Variable *l, Variable *r) {
-    Variable *n = new Variable();
-    n->set(l->type);
-    n->update(l->getBool() && r->getBool());
-    return n;
-  });
-  opMap.emplace("=", [](Variable *l, Variable *r) {
-    Variable *n = new Variable();
-    n->set(l->type);
-    if (l->type == Scanner::TokenType::INTEGER_LIT)
-      n->update(l->getInt() == r->getInt());
-    else if (l->type == Scanner::TokenType::BOOLEAN_LIT)
-      n->update(l->getBool() == r->getBool());
-    else
-      n->update(l->getString() == r->getString());
-    return n;
-  });
-  opMap.emplace("<", [](Variable *l, Variable *r) {
-    Variable *n = new Variable();
-    n->set(l->type);
-    if (l->type == Scanner::TokenType::INTEGER_LIT)
-      n->update(l->getInt() < r->getInt());
-    else if (l->type == Scanner::TokenType::BOOLEAN_LIT)
-      n->update(l->getBool() < r->getBool());
-    else
-      n->update(l->getString() < r->getString());
-    return n;
-  });
-  // Ignores left
-  opMap.emplace("!", [](Variable *l, Variable *r) {
-    Variable *n = new Variable();
-    n->set(r->type);
-    if (r->type == Scanner::TokenType::INTEGER_LIT)
-      n->update(!r->getInt());
-    else if (l->type == Scanner::TokenType::BOOLEAN_LIT)
-      n->update(!r->getBool());
-    return n;
-  });
+bool readValue(ValueType type, Value *value, std::string *error) {
+  std::string_view word;
+  bool more = IO::words().next(&word);
+  if (type == ValueType::STRING) {
+    *value = Value::string(std::string(word));
+    return true;
+  }
+  int32_t i;
+  bool b;
+  if (type == ValueType::INT && more && IO::parseInt(word, &i)) {
+    *value = Value::integer(i);
+    return true;
+  }
+  if (type == ValueType::BOOL && more && IO::parseBool(word, &b)) {
+    *value = Value::boolean(b);
+    return true;
+  }
+  *error = type == ValueType::INT ? "Expected an integer, got "
+                                  : "Expected true or false, got ";
+  if (more)
+    *error += "'" + std::string(word) + "'";
+  else
+    *error += "end of input";
+  return false;
 }
 
-void printStack_(std::stack<Variable *> &st) {
-  if (st.empty())
-    return;
-  Variable *x = st.top();
-  std::cout << "\tINT:" << x->getInt() << " STR:" << x->getString() << "\n";
-  st.pop();
-  printStack_(st);
-  st.push(x);
+// Expression stack. Storage is kept between pushes so that evaluating an
+// expression over ints and bools does not allocate.
+class ValueStack {
+public:
+  ValueStack() { values.resize(64); }
+  void push(Value v) {
+    if (size == values.size())
+      values.resize(2 * size);
+    values[size++] = std::move(v);
+  }
+  Value &top() { return values[size - 1]; }
+  void pop() { values[--size] = Value(); }
+  Value take() { return std::move(values[--size]); }
+  bool empty() const { return size == 0; }
+  const Value &at(size_t i) const { return values[i]; }
+  size_t count() const { return size; }
+
+private:
+  std::vector<Value> values;
+  size_t size = 0;
+};
+
+static void printStack_(const ValueStack &st) {
+  for (size_t i = st.count(); i > 0; i--) {
+    const Value &x = st.at(i - 1);
+    IO::out() << "\t" << Runtime::getName(x.type) << ":" << x.toString()
+              << "\n";
+  }
 }
 
-void printStack() {
-  std::cout << "========================\n";
-  std::cout << "Expr stack:\n";
+static void printStack(const ValueStack &varStack) {
+  IO::out() << "========================\n";
+  IO::out() << "Expr stack:\n";
   printStack_(varStack);
-  std::cout << "========================\n";
+  IO::out() << "========================\n";
 }
 
-void printVarMap() {
-  std::cout << "========================\n";
-  std::cout << "Variable map:\n";
-  for (auto const &[id, var] : varMap) {
-    std::cout << "\t"
-              << "id:" << id << " val:" << var->getString() << std::endl;
+static void printVarMap(const Resolver::Symbols &symbols,
+                        const std::vector<Value> &vars) {
+  IO::out() << "========================\n";
+  IO::out() << "Variable map:\n";
+  std::map<std::string, int> sorted(symbols.slots.begin(),
+                                    symbols.slots.end());
+  for (auto const &[id, slot] : sorted) {
+    IO::out() << "\t"
+              << "id:" << id << " val:" << vars[slot].toString() << std::endl;
   }
-  std::cout << "========================\n";
+  IO::out() << "========================\n";
 }
 
-void printDiag() {
-  printVarMap();
-  printStack();
+static void printDiag(const Resolver::Symbols &symbols,
+                      const std::vector<Value> &vars,
+                      const ValueStack &varStack) {
+  printVarMap(symbols, vars);
+  printStack(varStack);
 }
 
-std::string unEscape(std::string s) {
-  std::string o = "";
-  bool next = false;
-  for (char c : s) {
-    if (next) {
-      next = false;
-      switch (c) {
-      case 'n': {
-        c = '\n';
-        break;
-      }
-      case 't': {
-        c = '\t';
-        break;
-      }
-      case '\\': {
-        c = '\\';
-        break;
-      }
-      case '"': {
-        c = '\"';
-        break;
-      }
-      default: {
-      }
-      }
-    }
-    if (c == '\\') {
-      next = true;
-      continue;
-    }
-    o = o + c;
-  }
-  return o;
+static void print(const Value &v, ValueType type) {
+  if (type == ValueType::STRING)
+    IO::out() << v.getString();
+  else if (type == ValueType::INT)
+    IO::printInt(v.getInt());
+  else
+    IO::out() << (v.getBool() ? "true" : "false");
 }
 
-class InterpretWalker : public Parser::TreeWalker {
+// Expressions are evaluated on varStack in post-order, without recursion
+class InterpretWalker : public Parser::ExprWalker {
 public:
+  InterpretWalker(Context *c) : symbols(c->symbols), vars(c->vars) {}
+
   void visitOpnd(const Parser::Opnd *i) override { error("NOT IMPLEMENTED"); }
   void visitInt(const Parser::Int *i) override {
-    Variable *v = new Variable();
-    v->set(Scanner::TokenType::INTEGER_LIT, toStr(i->value));
-    varStack.push(v);
+    varStack.push(Value::integer(i->number()));
   }
   void visitBool(const Parser::Bool *b) override {
-    Variable *v = new Variable();
-    v->set(Scanner::TokenType::BOOLEAN_LIT, toStr(b->value));
-    varStack.push(v);
+    varStack.push(Value::boolean(b->value.start[0] == 't'));
   }
   void visitString(const Parser::String *s) override {
-    Variable *v = new Variable();
-    v->set(Scanner::TokenType::STRING_LIT, toStr(s->value));
-    varStack.push(v);
+    // Literal strings are built once and shared afterwards
+    auto it = literals.find(s);
+    if (it == literals.end()) {
+      Value v = Value::string(std::string(s->text));
+      it = literals.emplace(s, std::move(v)).first;
+    }
+    varStack.push(it->second);
   }
   void visitIdent(const Parser::Ident *i) override {
-    std::string id = toStr(i->ident);
-    if (!varMap.count(id))
-      error("Variable '" + id + "' has not been initialized");
-    varStack.push(varMap[id]);
+    varStack.push(vars[i->slot]);
   }
   void visitExpr(const Parser::Expr *e) override { error("NOT IMPLEMENTED"); }
   void visitBinary(const Parser::Binary *b) override {
-    b->left->accept(this);
-    Variable *l = varStack.top();
-    varStack.pop();
-    b->right->accept(this);
-    Variable *r = varStack.top();
-    varStack.pop();
-    varStack.push(opMap[toStr(b->op)](l, r));
-    // std::cout << "BINARY l:" << l->getInt() << " op:" << toStr(b->op)
-    //           << " r:" << r->getInt() << " res:" <<
-    //           varStack.top()->getInt()
-    //           << std::endl;
-    // printStack(varStack);
+    Value r = varStack.take();
+    Value l = varStack.take();
+    if (b->op.type == Scanner::TokenType::SLASH && r.getInt() == 0)
+      throw RuntimeError{b->op.line, "Division by zero"};
+    varStack.push(Runtime::getOp(b->op.type, b->left->type)(l, r));
   }
   void visitUnary(const Parser::Unary *u) override {
-    u->right->accept(this);
-    Variable *r = varStack.top();
-    varStack.pop();
-    r = opMap[toStr(u->op)](r, r);
-    varStack.push(r);
+    Value r = varStack.take();
+    varStack.push(Runtime::getOp(u->op.type, ValueType::BOOL)(r, r));
   }
-  void visitSingle(const Parser::Single *s) override { s->right->accept(this); }
+  void visitSingle(const Parser::Single *s) override {}
   void visitStmt(const Parser::Stmt *s) override {}
   void visitStmts(const Parser::Stmts *s) override {
     for (Parser::TreeNode *n : s->stmts) {
-      n->accept(this);
+      if (allocStats)
+        countAllocations(static_cast<Parser::Stmt *>(n));
+      else
+        n->accept(this);
     }
   }
   void visitVar(const Parser::Var *v) override {
-    std::string id = toStr(v->ident);
-    if (varMap.count(id))
-      error("Variable '" + id + "' already initialized");
     if (v->expr) {
-      v->expr->accept(this);
-      varMap[id] = varStack.top();
-      varStack.pop();
-      // if (varMap[id]->type != v->type.type) error("Could not set variable
-      // '"
-      // + id + "' to expression of type " + Scanner::getName(v->type));
+      walkExpr(v->expr);
+      vars[v->slot] = varStack.take();
     } else {
-      Variable *var = new Variable();
-      var->set(v->type.type);
-      varMap[id] = var;
+      vars[v->slot] = Value::zero(symbols.types[v->slot]);
     }
   }
   void visitAssign(const Parser::Assign *a) override {
-    std::string id = toStr(a->ident);
-    if (!varMap.count(id))
-      error("Variable '" + id + "' has not been initialized");
-    a->expr->accept(this);
-    varMap[id] = varStack.top();
-    varStack.pop();
+    walkExpr(a->expr);
+    vars[a->slot] = varStack.take();
   }
   void visitFor(const Parser::For *f) override {
-    std::string id = toStr(f->ident);
-    if (!varMap.count(id))
-      error("Variable '" + id + "' has not been initialized");
-    Variable *control = varMap[id];
-    f->from->accept(this);
-    f->to->accept(this);
-    int to = varStack.top()->getInt();
+    walkExpr(f->from);
+    walkExpr(f->to);
+    int to = varStack.top().getInt();
     varStack.pop();
-    int from = varStack.top()->getInt();
+    int from = varStack.top().getInt();
     varStack.pop();
-    control->update(from);
-    while (from <= to) {
-      control->constant = true;
+    int32_t step[Parser::MAX_INDUCTIONS];
+    for (uint32_t k = 0; k < f->inductionCount; k++) {
+      walkExpr(f->inductions[k].step);
+      step[k] = varStack.take().getInt();
+    }
+    // The resolver rules out writes to the control variable inside the loop,
+    // so it can be counted in place
+    Value &control = vars[f->slot];
+    control = Value::integer(from);
+    // Tested before the increment, which wraps around after INT32_MAX
+    for (bool more = from <= to; more;) {
       f->body->accept(this);
-      control->constant = false;
-      from++;
-      control->update(from);
+      for (uint32_t k = 0; k < f->inductionCount; k++) {
+        int32_t &v = vars[f->inductions[k].slot].as.i;
+        v = Runtime::Ops::add(v, step[k]);
+      }
+      more = control.as.i != to;
+      control.as.i = Runtime::Ops::add(control.as.i, 1);
     }
-    // error("NOT IMPLEMENTED");
   }
   void visitRead(const Parser::Read *r) override {
-    std::string id = toStr(r->ident);
-    if (!varMap.count(id))
-      error("Variable '" + id + "' has not been initialized");
-    std::string s;
-    std::cin >> s;
-
-    varMap[id]->update(s);
+    // Parse the input according to the declared type of the variable
+    std::string error;
+    if (!readValue(symbols.types[r->slot], &vars[r->slot], &error))
+      throw RuntimeError{r->ident.line, error};
   }
   void visitPrint(const Parser::Print *p) override {
-    p->expr->accept(this);
-    // std::cout << "<printing>";
-    //   printStack(varStack);
-    std::cout << unEscape(varStack.top()->getString());
+    walkExpr(p->expr);
+    print(varStack.top(), p->expr->type);
     varStack.pop();
   }
   void visitAssert(const Parser::Assert *a) override {
-    a->expr->accept(this);
-    if (!varStack.top()->getBool())
-      printDiag();
+    walkExpr(a->expr);
+    if (!varStack.top().getBool()) {
+      printDiag(symbols, vars, varStack);
+      assertFailed = true;
+    }
     varStack.pop();
   }
+
+  bool allocStats = false;
+  // The program goes on after a failed assert but ends with a runtime error
+  bool assertFailed = false;
+
+  // Literal strings are cached by node; nodes are freed between the
+  // statements of a stream and their addresses reused
+  void forgetLiterals() { literals.clear(); }
+
+  // Allocations made by statements of each kind, not counting the ones made
+  // by nested statements
+  void printAllocStats() {
+    size_t statements = 0, allocations = 0;
+    IO::err() << "Allocations per statement:\n";
+    for (auto const &[kind, stats] : allocs) {
+      statements += stats.executions;
+      allocations += stats.allocations;
+      IO::errorf("\t%-8s %10zu executed %10zu allocations %8.2f avg\n",
+                 kind.c_str(), stats.executions, stats.allocations,
+                 (double)stats.allocations / stats.executions);
+    }
+    IO::errorf("\t%-8s %10zu executed %10zu allocations %8.2f avg\n",
+               "total", statements, allocations,
+               statements ? (double)allocations / statements : 0.0);
+  }
+
+private:
+  const Resolver::Symbols &symbols;
+  std::vector<Value> &vars;
+  ValueStack varStack;
+  std::unordered_map<const Parser::String *, Value> literals;
+
+  struct AllocStats {
+    size_t executions = 0;
+    size_t allocations = 0;
+  };
+  std::map<std::string, AllocStats> allocs;
+  size_t attributed = 0;
+
+  void countAllocations(Parser::Stmt *s) {
+    size_t before = Memory::allocations();
+    size_t attributedBefore = attributed;
+    s->accept(this);
+    size_t total = Memory::allocations() - before;
+    size_t own = total - (attributed - attributedBefore);
+    // The stats entry itself is created outside the measured region
+    AllocStats &stats = allocs[s->info];
+    stats.executions++;
+    stats.allocations += own;
+    attributed = attributedBefore + total;
+  }
 };
 
-InterpretResult interpret(const std::string source) {
+// Tree walker over the flat program representation
+class FlatInterpretWalker : public Flat::Walker {
+public:
+  FlatInterpretWalker(const Flat::Tree &t, Context *c)
+      : Flat::Walker(t), symbols(c->symbols), vars(c->vars) {
+    for (uint32_t i = 0; i < t.stringValue.size(); i++)
+      literals.push_back(Value::string(std::string(t.stringText(i))));
+  }
+
+  void visitInt(uint32_t i) override {
+    varStack.push(Value::integer(tree.intValue[i]));
+  }
+  void visitBool(uint32_t i) override {
+    varStack.push(Value::boolean(tree.boolValue[i]));
+  }
+  void visitString(uint32_t i) override { varStack.push(literals[i]); }
+  void visitIdent(uint32_t i) override {
+    varStack.push(vars[tree.identSlot[i]]);
+  }
+  void visitBinary(uint32_t i) override {
+    Value r = varStack.take();
+    Value l = varStack.take();
+    Scanner::TokenType op = (Scanner::TokenType)tree.binaryOp[i];
+    if (op == Scanner::TokenType::SLASH && r.getInt() == 0)
+      throw RuntimeError{tree.line(tree.offset[(int)Flat::Kind::BINARY][i]),
+                         "Division by zero"};
+    varStack.push(Runtime::getOp(op, (ValueType)tree.binaryType[i])(l, r));
+  }
+  void visitUnary(uint32_t i) override {
+    Value r = varStack.take();
+    varStack.push(Runtime::getOp((Scanner::TokenType)tree.unaryOp[i],
+                                 ValueType::BOOL)(r, r));
+  }
+  void visitVar(uint32_t i) override {
+    uint32_t slot = tree.varSlot[i];
+    if (tree.varInit[i] != Flat::NONE) {
+      walkExpr(tree.varInit[i]);
+      vars[slot] = varStack.take();
+    } else {
+      vars[slot] = Value::zero(symbols.types[slot]);
+    }
+  }
+  void visitAssign(uint32_t i) override {
+    walkExpr(tree.assignExpr[i]);
+    vars[tree.assignSlot[i]] = varStack.take();
+  }
+  void visitFor(uint32_t i) override {
+    walkExpr(tree.forFrom[i]);
+    walkExpr(tree.forTo[i]);
+    int to = varStack.take().getInt();
+    int from = varStack.take().getInt();
+    Flat::Range inductions = tree.forInductions[i];
+    int32_t step[Parser::MAX_INDUCTIONS];
+    for (uint32_t k = inductions.begin; k < inductions.end; k++) {
+      walkExpr(tree.inductionStep[k]);
+      step[k - inductions.begin] = varStack.take().getInt();
+    }
+    Value &control = vars[tree.forSlot[i]];
+    Flat::Range body = tree.forBody[i];
+    control = Value::integer(from);
+    // Tested before the increment, which wraps around after INT32_MAX
+    for (bool more = from <= to; more;) {
+      walk(body);
+      for (uint32_t k = inductions.begin; k < inductions.end; k++) {
+        int32_t &v = vars[tree.inductionSlot[k]].as.i;
+        v = Runtime::Ops::add(v, step[k - inductions.begin]);
+      }
+      more = control.as.i != to;
+      control.as.i = Runtime::Ops::add(control.as.i, 1);
+    }
+  }
+  void visitRead(uint32_t i) override {
+    uint32_t slot = tree.readSlot[i];
+    std::string error;
+    if (!readValue(symbols.types[slot], &vars[slot], &error))
+      throw RuntimeError{tree.line(tree.offset[(int)Flat::Kind::READ][i]),
+                         error};
+  }
+  void visitPrint(uint32_t i) override {
+    walkExpr(tree.printExpr[i]);
+    print(varStack.top(), (ValueType)tree.printType[i]);
+    varStack.pop();
+  }
+  void visitAssert(uint32_t i) override {
+    walkExpr(tree.assertExpr[i]);
+    if (!varStack.top().getBool()) {
+      printDiag(symbols, vars, varStack);
+      assertFailed = true;
+    }
+    varStack.pop();
+  }
+
+  bool assertFailed = false;
+
+private:
+  const Resolver::Symbols &symbols;
+  std::vector<Value> &vars;
+  ValueStack varStack;
+  std::vector<Value> literals;
+};
+
+// Gives the variables declared since the last run their slots. A run that
+// stops with a runtime error can leave declarations unexecuted, so each
+// slot starts as the zero value of its type.
+static void addVars(Context *context) {
+  for (int i = context->vars.size(); i < context->symbols.size(); i++)
+    context->vars.push_back(Value::zero(context->symbols.types[i]));
+}
+
+static InterpretResult runFlat(Context *context, std::string_view source,
+                               bool optimize) {
+  Flat::Tree tree;
+  {
+    Parser::Program program;
+    if (!Compiler::analyze(source, &program, &context->symbols, optimize))
+      return InterpretResult::COMPILE_ERROR;
+    Flat::lower(program, &tree);
+    // The pointer tree is not needed once the flat tree is built
+  }
+  addVars(context);
+  FlatInterpretWalker fw(tree, context);
+  fw.walk(tree.program);
+  return fw.assertFailed ? InterpretResult::RUNTIME_ERROR : InterpretResult::OK;
+}
+
+static InterpretResult runVM(std::string_view source,
+                             const Options &options) {
+  Compiler::Chunk chunk;
+  std::string cached;
+  uint64_t key = 0;
+  if (!options.cacheDir.empty()) {
+    key = Cache::key(source, options.optimize);
+    cached = Cache::path(options.cacheDir, key);
+    if (Cache::load(cached, key, &chunk))
+      return VM::run(chunk, options);
+  }
+  {
+    Parser::Program program;
+    Resolver::Symbols symbols;
+    if (!Compiler::analyze(source, &program, &symbols, options.optimize))
+      return InterpretResult::COMPILE_ERROR;
+    Compiler::compile(program.stmts, symbols, &chunk);
+  }
+  // A cache that cannot be written only costs the next run its speedup
+  if (!cached.empty())
+    Cache::store(chunk, key, cached);
+  return VM::run(chunk, options);
+}
+
+// Runs source statement by statement with the tree walker. After an error
+// the rest of the source is still analyzed, to report its errors as well,
+// but no longer run.
+static InterpretResult runStream(Context *context, std::string_view source,
+                                 const Options &options) {
+  Parser::Stream stream(source);
+  Parser::Program unit;
+  InterpretWalker iw(context);
+  iw.allocStats = options.allocStats;
+  bool failed = false;
+  while (stream.next(&unit)) {
+    // Statements with syntax errors are incomplete and never analyzed
+    if (stream.hadError() ||
+        !Compiler::analyze(&unit, &context->symbols, options.optimize)) {
+      failed = true;
+      continue;
+    }
+    if (failed)
+      continue;
+    addVars(context);
+    iw.forgetLiterals();
+    unit.stmts->accept(&iw);
+  }
+  if (options.allocStats)
+    iw.printAllocStats();
+  if (failed || stream.hadError())
+    return InterpretResult::COMPILE_ERROR;
+  return iw.assertFailed ? InterpretResult::RUNTIME_ERROR : InterpretResult::OK;
+}
+
+static InterpretResult runWalker(Context *context, std::string_view source,
+                                 const Options &options) {
   try {
+    if (options.backend == Backend::FLAT)
+      return runFlat(context, source, options.optimize);
+    if (options.stream)
+      return runStream(context, source, options);
     // Compiler::runScanner(source);
     // Compiler::runParser(source);
-    init();
-    InterpretWalker *iw = new InterpretWalker();
-    // iw->visitPrint(new Parser::Print());
-    Parser::parseAndWalk(source, iw);
+    Parser::Program program;
+    if (!Compiler::analyze(source, &program, &context->symbols,
+                           options.optimize))
+      return InterpretResult::COMPILE_ERROR;
+    addVars(context);
+    InterpretWalker iw(context);
+    iw.allocStats = options.allocStats;
+    program.stmts->accept(&iw);
+    if (options.allocStats)
+      iw.printAllocStats();
+    if (iw.assertFailed)
+      return InterpretResult::RUNTIME_ERROR;
   } catch (int e) {
     return InterpretResult::COMPILE_ERROR;
+  } catch (RuntimeError &e) {
+    if (e.line > 0)
+      IO::errorf("[line %d] Runtime error: %s\n", e.line, e.message.c_str());
+    else
+      IO::errorf("Runtime error: %s\n", e.message.c_str());
+    return InterpretResult::RUNTIME_ERROR;
   }
   return InterpretResult::OK;
 }
 
+InterpretResult interpret(Context *context, std::string_view source,
+                          const Options &options) {
+  if (options.backend == Backend::VM)
+    return runVM(source, options);
+  int declared = context->symbols.size();
+  InterpretResult result = runWalker(context, source, options);
+  // Variables declared by a source that fails to compile are forgotten, so
+  // that the next REPL line can declare them again
+  if (result == InterpretResult::COMPILE_ERROR) {
+    context->symbols.truncate(declared);
+    context->vars.resize(std::min((int)context->vars.size(), declared));
+  }
+  return result;
+}
+
+InterpretResult interpret(std::string_view source, const Options &options) {
+  Context context;
+  return interpret(&context, source, options);
+}
+
+int exitStatus(InterpretResult result) {
+  switch (result) {
+  case InterpretResult::OK:
+    return 0;
+  case InterpretResult::RUNTIME_ERROR:
+    return 1;
+  case InterpretResult::COMPILE_ERROR:
+    return 2;
+  }
+  return 1;
+}
+
 } // namespace Interpreter
@@ -1,7 +1,11 @@
 #ifndef INTERPRETER_H_
 #define INTERPRETER_H_
 
+#include "resolver.h"
+#include "value.h"
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace Interpreter {
 
@@ -11,7 +15,63 @@ enum class InterpretResult {
   COMPILE_ERROR,
 };
 
-InterpretResult interpret(const std::string source);
+enum class Backend {
+  WALKER, // evaluate the syntax tree directly
+  FLAT,   // evaluate the flat structure-of-arrays tree
+  VM,     // compile to bytecode and run it on the VM
+};
+
+enum class JitMode {
+  OFF,   // always interpret
+  ON,    // compile loops once they have run enough iterations
+  FORCE, // compile every loop the first time it is entered
+};
+
+struct Options {
+  Backend backend = Backend::WALKER;
+  // Report heap allocations per executed statement (tree walker only)
+  bool allocStats = false;
+  // Run each top-level statement as soon as it has been parsed and free it
+  // afterwards, instead of parsing the whole program first (tree walker
+  // only). Output starts right away and memory stays bounded by the largest
+  // statement, but statements before an error in a later one have already
+  // run by the time it is reported.
+  bool stream = false;
+  // Fold constants and drop dead statements before running
+  bool optimize = true;
+  // Native code for hot int/bool loops (bytecode VM on x86-64 only)
+  JitMode jit = JitMode::ON;
+  // Report loops compiled or rejected by the JIT to stderr
+  bool jitLog = false;
+  // Directory of precompiled programs (bytecode VM only). If set, a program
+  // whose source has been compiled before is loaded from there instead of
+  // being parsed, and new ones are added.
+  std::string cacheDir;
+};
+
+// State of one interpreter session: the variables declared so far and their
+// values. Sessions share no mutable state, so separate ones can run on
+// separate threads. The REPL keeps one across lines.
+struct Context {
+  Resolver::Symbols symbols;
+  std::vector<Runtime::Value> vars;
+};
+
+// Reads the next word of IO::words() as a value of the given type. Returns
+// false with a description in error if the word is malformed or the input
+// has ended; a string read at the end of the input is empty.
+bool readValue(Runtime::ValueType type, Runtime::Value *value,
+               std::string *error);
+
+InterpretResult interpret(Context *context, std::string_view source,
+                          const Options &options = Options());
+// Runs source in a fresh context
+InterpretResult interpret(std::string_view source,
+                          const Options &options = Options());
+
+// Exit status of a run, the same for every backend and the compiled
+// program: 0 ok, 1 runtime error or failed assert, 2 compile error
+int exitStatus(InterpretResult result);
 
 } // namespace Interpreter
 
@@ -0,0 +1,348 @@
+#include "io.h"
+#include <algorithm>
+#include <charconv>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace IO {
+
+static thread_local std::istream *input = &std::cin;
+static thread_local std::ostream *output = &std::cout;
+static thread_local std::ostream *errors = &std::cerr;
+
+std::istream &in() { return *input; }
+std::ostream &out() { return *output; }
+std::ostream &err() { return *errors; }
+
+void printInt(int32_t i) {
+  char buf[16];
+  char *end = std::to_chars(buf, buf + sizeof buf, i).ptr;
+  output->write(buf, end - buf);
+}
+
+void errorf(const char *format, ...) {
+  char buf[256];
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(buf, sizeof buf, format, args);
+  va_end(args);
+  if (n < 0)
+    return;
+  if ((size_t)n < sizeof buf) {
+    errors->write(buf, n);
+    return;
+  }
+  std::string s(n, '\0');
+  va_start(args, format);
+  vsnprintf(&s[0], n + 1, format, args);
+  va_end(args);
+  *errors << s;
+}
+
+Redirect::Redirect(std::istream &in, std::ostream &out, std::ostream &err)
+    : savedIn(input), savedOut(output), savedErr(errors) {
+  input = &in;
+  output = &out;
+  errors = &err;
+}
+
+Redirect::~Redirect() {
+  input = savedIn;
+  output = savedOut;
+  errors = savedErr;
+}
+
+static thread_local Input *currentInput = nullptr;
+
+Input &words() {
+  static thread_local Input standard;
+  return currentInput ? *currentInput : standard;
+}
+
+ReadFrom::ReadFrom(Input &input) : saved(currentInput) {
+  currentInput = &input;
+}
+
+ReadFrom::~ReadFrom() { currentInput = saved; }
+
+static bool isSpace(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+bool Input::open(const std::string &path) {
+  int f = path == "-" ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY);
+  if (f < 0)
+    return false;
+  fd = f;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      madvise(p, st.st_size, MADV_SEQUENTIAL);
+      mapped = (const char *)p;
+      mappedSize = st.st_size;
+      // Standard input may already have been read from
+      off_t offset = lseek(fd, 0, SEEK_CUR);
+      pos = mapped + (offset > 0 && offset <= st.st_size ? offset : 0);
+      end = mapped + mappedSize;
+      return true;
+    }
+  }
+  // Pipes and terminals are read a block at a time, as far as available
+  int savedErrno = errno;
+  interactive = isatty(fd);
+  errno = savedErrno;
+  buffer.resize(1 << 16);
+  pos = end = buffer.data();
+  return true;
+}
+
+Input::~Input() {
+  if (mapped)
+    munmap((void *)mapped, mappedSize);
+  if (fd > STDIN_FILENO)
+    close(fd);
+}
+
+// Moves the unread text from start on to the front of the buffer and reads
+// more after it. Returns false at the end of the file.
+bool Input::fill(const char **start) {
+  if (mapped || fd < 0)
+    return false;
+  size_t kept = end - *start;
+  memmove(buffer.data(), *start, kept);
+  if (kept == buffer.size())
+    buffer.resize(2 * buffer.size());
+  *start = buffer.data();
+  pos = buffer.data() + kept;
+  end = pos;
+  // The prompt for the input has to be visible before waiting for it
+  if (interactive)
+    out().flush();
+  ssize_t n;
+  do
+    n = ::read(fd, buffer.data() + kept, buffer.size() - kept);
+  while (n < 0 && errno == EINTR);
+  if (n <= 0)
+    return false;
+  end += n;
+  return true;
+}
+
+bool Input::next(std::string_view *w) {
+  if (fd < 0)
+    return nextFromStream(w);
+  for (;;) {
+    while (pos < end && isSpace(*pos))
+      pos++;
+    if (pos < end)
+      break;
+    const char *start = end;
+    if (!fill(&start))
+      return false;
+  }
+  const char *start = pos;
+  for (;;) {
+    while (pos < end && !isSpace(*pos))
+      pos++;
+    if (pos < end || !fill(&start))
+      break;
+  }
+  *w = std::string_view(start, pos - start);
+  return true;
+}
+
+bool Input::nextFromStream(std::string_view *w) {
+  std::istream &stream = in();
+  if (std::ostream *tied = stream.tie())
+    tied->flush();
+  std::streambuf *b = stream.rdbuf();
+  using Traits = std::streambuf::traits_type;
+  int c = b->sgetc();
+  while (c != Traits::eof() && isSpace(Traits::to_char_type(c)))
+    c = b->snextc();
+  if (c == Traits::eof())
+    return false;
+  word.clear();
+  while (c != Traits::eof() && !isSpace(Traits::to_char_type(c))) {
+    word.push_back(Traits::to_char_type(c));
+    c = b->snextc();
+  }
+  *w = word;
+  return true;
+}
+
+bool parseInt(std::string_view word, int32_t *value) {
+  const char *first = word.data();
+  const char *last = first + word.size();
+  // from_chars takes a minus sign but not a plus
+  if (first != last && *first == '+' && last - first > 1 && first[1] != '-')
+    first++;
+  auto [ptr, ec] = std::from_chars(first, last, *value);
+  return ec == std::errc() && ptr == last && first != last;
+}
+
+bool parseBool(std::string_view word, bool *value) {
+  if (word == "true")
+    *value = true;
+  else if (word == "false")
+    *value = false;
+  else
+    return false;
+  return true;
+}
+
+class BufferedOutput::FileBuffer : public std::streambuf {
+public:
+  FileBuffer(int fd, size_t size, bool lineBuffered)
+      : fd(fd), buffer(std::max<size_t>(size, 1)), lineBuffered(lineBuffered) {
+    setp(buffer.data(), buffer.data() + buffer.size());
+  }
+
+  // Writes what is buffered with nothing but write(2), from a signal handler
+  void salvage() { writeAll(pbase(), pptr() - pbase()); }
+
+protected:
+  int_type overflow(int_type c) override {
+    if (drain() != 0)
+      return traits_type::eof();
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+      return traits_type::not_eof(c);
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+    if (lineBuffered && c == '\n' && drain() != 0)
+      return traits_type::eof();
+    return c;
+  }
+  std::streamsize xsputn(const char *s, std::streamsize n) override {
+    // Writes that would not fit anyway skip the buffer
+    if ((size_t)n > buffer.size()) {
+      if (drain() != 0 || !writeAll(s, n))
+        return 0;
+    } else if (std::streambuf::xsputn(s, n) != n) {
+      return 0;
+    }
+    if (lineBuffered && memchr(s, '\n', n) && drain() != 0)
+      return 0;
+    return n;
+  }
+  int sync() override { return drain(); }
+
+private:
+  int fd;
+  std::vector<char> buffer;
+  bool lineBuffered;
+
+  bool writeAll(const char *s, size_t n) {
+    while (n > 0) {
+      ssize_t w = ::write(fd, s, n);
+      if (w < 0 && errno == EINTR)
+        continue;
+      if (w <= 0)
+        return false;
+      s += w;
+      n -= w;
+    }
+    return true;
+  }
+  int drain() {
+    bool ok = writeAll(pbase(), pptr() - pbase());
+    setp(buffer.data(), buffer.data() + buffer.size());
+    return ok ? 0 : -1;
+  }
+};
+
+// Signals that end the process, after which the buffered output would be
+// lost. std::terminate ends up in SIGABRT.
+static const int FATAL_SIGNALS[] = {SIGABRT, SIGBUS, SIGFPE, SIGILL,
+                                    SIGINT,  SIGSEGV, SIGTERM};
+static const int FATAL_SIGNAL_COUNT = sizeof FATAL_SIGNALS / sizeof(int);
+static BufferedOutput::FileBuffer *fatalBuffer = nullptr;
+static struct sigaction savedActions[FATAL_SIGNAL_COUNT];
+
+// Writes the buffered output and dies of the signal as it would have
+static void flushAndDie(int sig) {
+  if (fatalBuffer)
+    fatalBuffer->salvage();
+  for (int i = 0; i < FATAL_SIGNAL_COUNT; i++)
+    if (FATAL_SIGNALS[i] == sig)
+      sigaction(sig, &savedActions[i], nullptr);
+  raise(sig);
+}
+
+BufferedOutput::BufferedOutput(size_t size, bool lineBuffered)
+    : buffer(new FileBuffer(STDOUT_FILENO, size, lineBuffered)) {
+  // Earlier output through stdio goes first
+  std::cout.flush();
+  fflush(stdout);
+  saved = std::cout.rdbuf(buffer.get());
+  // Input from a file or pipe can not depend on the output, so only reads
+  // from a terminal need the output flushed first. isatty sets errno, which
+  // the driver reports as the exit status.
+  int savedErrno = errno;
+  savedTie = std::cin.tie(isatty(STDIN_FILENO) ? &std::cout : nullptr);
+  errno = savedErrno;
+  fatalBuffer = buffer.get();
+  struct sigaction action = {};
+  action.sa_handler = flushAndDie;
+  sigemptyset(&action.sa_mask);
+  for (int i = 0; i < FATAL_SIGNAL_COUNT; i++)
+    sigaction(FATAL_SIGNALS[i], &action, &savedActions[i]);
+}
+
+BufferedOutput::~BufferedOutput() {
+  for (int i = 0; i < FATAL_SIGNAL_COUNT; i++)
+    sigaction(FATAL_SIGNALS[i], &savedActions[i], nullptr);
+  fatalBuffer = nullptr;
+  std::cout.flush();
+  std::cin.tie(savedTie);
+  std::cout.rdbuf(saved);
+}
+
+bool MappedFile::open(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  if (S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      madvise(p, st.st_size, MADV_SEQUENTIAL);
+      close(fd);
+      data = (const char *)p;
+      size = st.st_size;
+      mapped = true;
+      return true;
+    }
+  }
+  char buf[65536];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof buf)) > 0)
+    contents.append(buf, n);
+  close(fd);
+  if (n < 0)
+    return false;
+  data = contents.data();
+  size = contents.size();
+  return true;
+}
+
+MappedFile::~MappedFile() {
+  if (mapped)
+    munmap((void *)data, size);
+}
+
+} // namespace IO
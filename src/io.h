@@ -0,0 +1,144 @@
+#ifndef IO_H_
+#define IO_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Streams a running program reads and writes: its input, its output and
+// the diagnostics about it. They are the standard streams unless a
+// Redirect on the current thread points them elsewhere, which is how the
+// batch runner captures each program separately.
+namespace IO {
+
+std::istream &in();
+std::ostream &out();
+std::ostream &err();
+
+// Writes i to out() in decimal, without the locale machinery of operator<<
+void printInt(int32_t i);
+
+// Writes printf-style formatted text to err()
+void errorf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+// Sends the current thread's program streams to the given ones until it
+// goes out of scope
+class Redirect {
+public:
+  Redirect(std::istream &in, std::ostream &out, std::ostream &err);
+  Redirect(const Redirect &) = delete;
+  Redirect &operator=(const Redirect &) = delete;
+  ~Redirect();
+
+private:
+  std::istream *savedIn;
+  std::ostream *savedOut;
+  std::ostream *savedErr;
+};
+
+// Whitespace-separated words of a program's input, read without iostreams.
+// By default the words are taken from in() one character at a time, so that
+// nothing past the last word is consumed. After open() they come from a
+// file, or standard input, mapped into memory or read in large blocks.
+class Input {
+public:
+  Input() = default;
+  Input(const Input &) = delete;
+  Input &operator=(const Input &) = delete;
+  ~Input();
+
+  // Reads the file at path, or standard input if path is "-". Returns false
+  // if it cannot be opened.
+  bool open(const std::string &path);
+  // Stores the next word in word, valid until the next call. Returns false
+  // at the end of the input.
+  bool next(std::string_view *word);
+
+private:
+  int fd = -1;
+  bool interactive = false;
+  const char *mapped = nullptr;
+  size_t mappedSize = 0;
+  std::vector<char> buffer;
+  const char *pos = nullptr;
+  const char *end = nullptr;
+  std::string word;
+
+  bool fill(const char **start);
+  bool nextFromStream(std::string_view *word);
+};
+
+// Input of the current thread's program
+Input &words();
+
+// Makes words() return the given input on the current thread until it goes
+// out of scope
+class ReadFrom {
+public:
+  explicit ReadFrom(Input &input);
+  ReadFrom(const ReadFrom &) = delete;
+  ReadFrom &operator=(const ReadFrom &) = delete;
+  ~ReadFrom();
+
+private:
+  Input *saved;
+};
+
+// Values of input words. An integer is an optional sign and decimal digits
+// within 32 bits, a boolean is true or false; anything else is rejected.
+bool parseInt(std::string_view word, int32_t *value);
+bool parseBool(std::string_view word, bool *value);
+
+const size_t DEFAULT_OUTPUT_BUFFER = 1 << 20;
+
+// Collects everything written to std::cout while it is in scope and writes
+// it to standard output in blocks of size bytes. Output is also written when
+// std::cout is flushed, which reading from a terminal and writing to
+// std::cerr do, and at the end of the scope, or when the process is killed
+// by a signal such as SIGFPE, SIGSEGV or the SIGABRT of std::terminate. With
+// lineBuffered every complete line is written right away, for interactive
+// use.
+class BufferedOutput {
+public:
+  class FileBuffer;
+
+  explicit BufferedOutput(size_t size = DEFAULT_OUTPUT_BUFFER,
+                          bool lineBuffered = false);
+  BufferedOutput(const BufferedOutput &) = delete;
+  BufferedOutput &operator=(const BufferedOutput &) = delete;
+  ~BufferedOutput();
+
+private:
+  std::unique_ptr<FileBuffer> buffer;
+  std::streambuf *saved;
+  std::ostream *savedTie;
+};
+
+// Contents of a file, mapped into memory rather than copied. Files that
+// cannot be mapped, such as pipes, are read into memory instead.
+class MappedFile {
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+
+  // Returns false if the file cannot be opened or read
+  bool open(const std::string &path);
+  std::string_view text() const { return std::string_view(data, size); }
+
+private:
+  const char *data = nullptr;
+  size_t size = 0;
+  bool mapped = false;
+  std::string contents;
+};
+
+} // namespace IO
+
+#endif // IO_H_
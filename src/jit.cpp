@@ -0,0 +1,309 @@
+#include "jit.h"
+#include "io.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_X86_64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace Jit {
+
+using Compiler::OpCode;
+using Runtime::Value;
+using Runtime::ValueType;
+
+// Iterations a loop runs in the VM, counted at loop entry, before it is
+// compiled
+static const int64_t HOT_ITERATIONS = 1000;
+
+#define F(name, operands) operands,
+static const int Operands[]{OP_CODES(F)};
+#undef F
+
+#ifdef JIT_X86_64
+
+static_assert(sizeof(Value) == 16, "slots are addressed as 16-byte values");
+
+// Translates one loop. Register use: rbx holds the slot array, eax caches
+// the top of the VM value stack and the rest of the stack lives on the
+// machine stack. The code makes no calls.
+class Translator {
+public:
+  const Compiler::Chunk &chunk;
+  std::vector<uint8_t> code;
+  // Why the loop can not be compiled
+  std::string reason;
+
+  Translator(const Compiler::Chunk &c) : chunk(c) {}
+
+  bool translate(size_t start) {
+    size_t end = start + 9 + chunk.read32(start + 5);
+    std::vector<int32_t> native(end - start + 1);
+    emit({0x53});             // push rbx
+    emit({0x55});             // push rbp
+    emit({0x48, 0x89, 0xe5}); // mov rbp, rsp
+    emit({0x48, 0x89, 0xfb}); // mov rbx, rdi
+    emit({0x56});             // push rsi: from
+    emit({0x89, 0xd0});       // mov eax, edx: to
+    for (size_t offset = start; offset < end;) {
+      native[offset - start] = code.size();
+      OpCode op = (OpCode)chunk.code[offset];
+      size_t next = offset + 1 + 4 * Operands[(int)op];
+      if (!instruction(op, offset, next))
+        return false;
+      offset = next;
+    }
+    native[end - start] = code.size();
+    emit({0x48, 0xc7, 0xc0}); // mov rax, -1
+    imm32(-1);
+    size_t exit = code.size();
+    emit({0x48, 0x89, 0xec}); // mov rsp, rbp
+    emit({0x5d});             // pop rbp
+    emit({0x5b});             // pop rbx
+    emit({0xc3});             // ret
+    for (const Jump &j : jumps)
+      patch(j.at, native[j.target - start]);
+    for (const Jump &j : divisions) {
+      patch(j.at, code.size());
+      emit({0xb8}); // mov eax, offset
+      imm32(j.target);
+      emit({0xe9}); // jmp exit
+      imm32(exit - (code.size() + 4));
+    }
+    return true;
+  }
+
+private:
+  // A rel32 at code offset at that jumps to bytecode offset target, or for
+  // divisions, reports the division at target
+  struct Jump {
+    size_t at;
+    size_t target;
+  };
+  std::vector<Jump> jumps;
+  std::vector<Jump> divisions;
+
+  void emit(std::initializer_list<uint8_t> bytes) {
+    code.insert(code.end(), bytes);
+  }
+  void imm32(int32_t v) {
+    for (int i = 0; i < 4; i++)
+      code.push_back((uint32_t)v >> (8 * i));
+  }
+  void patch(size_t at, size_t to) {
+    int32_t rel = to - (at + 4);
+    memcpy(&code[at], &rel, 4);
+  }
+  void jump(std::initializer_list<uint8_t> op, size_t target) {
+    emit(op);
+    jumps.push_back({code.size(), target});
+    imm32(0);
+  }
+  static int32_t payload(uint32_t slot) {
+    return slot * sizeof(Value) + offsetof(Value, as);
+  }
+  static int32_t tag(uint32_t slot) {
+    return slot * sizeof(Value) + offsetof(Value, type);
+  }
+  bool scalar(uint32_t slot) {
+    if (chunk.types[slot] != ValueType::STRING)
+      return true;
+    reason = "string variable '" + chunk.names[slot] + "'";
+    return false;
+  }
+  // Pops the second entry of the stack into ecx
+  void popSecond() { emit({0x59}); }
+
+  bool instruction(OpCode op, size_t offset, size_t next) {
+    uint32_t a = Operands[(int)op] > 0 ? chunk.read32(offset + 1) : 0;
+    uint32_t b = Operands[(int)op] > 1 ? chunk.read32(offset + 5) : 0;
+    switch (op) {
+    case OpCode::INT:
+      emit({0x50, 0xb8}); // push rax; mov eax, imm
+      imm32(a);
+      return true;
+    case OpCode::TRUE:
+      emit({0x50, 0xb8}); // push rax; mov eax, 1
+      imm32(1);
+      return true;
+    case OpCode::FALSE:
+      emit({0x50, 0x31, 0xc0}); // push rax; xor eax, eax
+      return true;
+    case OpCode::GET:
+      if (!scalar(a))
+        return false;
+      emit({0x50}); // push rax
+      if (chunk.types[a] == ValueType::INT)
+        emit({0x8b, 0x83}); // mov eax, [rbx + d]
+      else
+        emit({0x0f, 0xb6, 0x83}); // movzx eax, byte [rbx + d]
+      imm32(payload(a));
+      return true;
+    case OpCode::SET:
+      if (!scalar(a))
+        return false;
+      if (chunk.types[a] == ValueType::INT)
+        emit({0x89, 0x83}); // mov [rbx + d], eax
+      else
+        emit({0x88, 0x83}); // mov [rbx + d], al
+      imm32(payload(a));
+      emit({0xc6, 0x83}); // mov byte [rbx + d], type
+      imm32(tag(a));
+      code.push_back((uint8_t)chunk.types[a]);
+      emit({0x58}); // pop rax
+      return true;
+    case OpCode::POP:
+      emit({0x58}); // pop rax
+      return true;
+    case OpCode::ADD:
+      popSecond();
+      emit({0x01, 0xc8}); // add eax, ecx
+      return true;
+    case OpCode::SUB:
+      popSecond();
+      emit({0x29, 0xc1, 0x89, 0xc8}); // sub ecx, eax; mov eax, ecx
+      return true;
+    case OpCode::MUL:
+      popSecond();
+      emit({0x0f, 0xaf, 0xc1}); // imul eax, ecx
+      return true;
+    case OpCode::DIV:
+      emit({0x85, 0xc0, 0x0f, 0x84}); // test eax, eax; jz error
+      divisions.push_back({code.size(), offset});
+      imm32(0);
+      // INT32_MIN / -1 would trap in idiv; dividing by -1 negates, wrapping
+      // like Ops::divide. cmp eax, -1; jne div; pop rcx; neg ecx;
+      // mov eax, ecx; jmp done
+      emit({0x83, 0xf8, 0xff, 0x75, 0x07, 0x59, 0xf7, 0xd9, 0x89, 0xc8, 0xeb,
+            0x06});
+      // div: mov ecx, eax; pop rax; cdq; idiv ecx; done:
+      emit({0x89, 0xc1, 0x58, 0x99, 0xf7, 0xf9});
+      return true;
+    case OpCode::LESS_INT:
+    case OpCode::EQUAL_INT:
+    case OpCode::LESS_BOOL:
+    case OpCode::EQUAL_BOOL:
+      popSecond();
+      emit({0x39, 0xc1}); // cmp ecx, eax
+      if (op == OpCode::LESS_INT)
+        emit({0x0f, 0x9c, 0xc0}); // setl al
+      else if (op == OpCode::LESS_BOOL)
+        emit({0x0f, 0x92, 0xc0}); // setb al
+      else
+        emit({0x0f, 0x94, 0xc0}); // sete al
+      emit({0x0f, 0xb6, 0xc0});   // movzx eax, al
+      return true;
+    case OpCode::AND:
+      popSecond();
+      emit({0x21, 0xc8}); // and eax, ecx
+      return true;
+    case OpCode::NOT:
+      emit({0x83, 0xf0, 0x01}); // xor eax, 1
+      return true;
+    case OpCode::FOR_PREP:
+      // [from to] -> [to]; the end value stays cached in eax
+      popSecond();
+      emit({0x89, 0x8b}); // mov [rbx + d], ecx
+      imm32(payload(a));
+      emit({0xc6, 0x83}); // mov byte [rbx + d], INT
+      imm32(tag(a));
+      code.push_back((uint8_t)ValueType::INT);
+      emit({0x39, 0xc1});             // cmp ecx, eax
+      jump({0x0f, 0x8f}, next + b); // jg exit
+      return true;
+    case OpCode::FOR_LOOP:
+      // Compares the value before the increment, which wraps around after
+      // INT32_MAX
+      emit({0x8b, 0x8b}); // mov ecx, [rbx + d]
+      imm32(payload(a));
+      emit({0xff, 0x83}); // inc dword [rbx + d]
+      imm32(payload(a));
+      emit({0x39, 0xc1});             // cmp ecx, eax
+      jump({0x0f, 0x85}, next - b); // jne body
+      return true;
+    default:
+      reason = Compiler::getName(op);
+      return false;
+    }
+  }
+};
+
+#endif
+
+Tier::Tier(const Compiler::Chunk &c, Interpreter::JitMode m, bool l)
+    : chunk(c), mode(m), log(l) {
+  for (size_t i = 0; i < chunk.code.size();
+       i += 1 + 4 * Operands[chunk.code[i]])
+    if ((OpCode)chunk.code[i] == OpCode::FOR_PREP)
+      loops[i];
+}
+
+Tier::~Tier() {
+#ifdef JIT_X86_64
+  for (auto &[mem, size] : buffers)
+    munmap(mem, size);
+#endif
+}
+
+LoopFn Tier::enter(size_t offset, int32_t from, int32_t to) {
+  Loop &loop = loops.at(offset);
+  LoopFn fn = loop.fn.load(std::memory_order_acquire);
+  if (fn || loop.rejected.load(std::memory_order_relaxed))
+    return fn;
+  int64_t n = 1 + std::max<int64_t>(0, (int64_t)to - from + 1);
+  int64_t iterations =
+      loop.iterations.fetch_add(n, std::memory_order_relaxed) + n;
+  if (mode != Interpreter::JitMode::FORCE && iterations < HOT_ITERATIONS)
+    return nullptr;
+  // Another run may have compiled the loop while this one waited
+  std::lock_guard<std::mutex> lock(compiling);
+  if (!loop.fn.load(std::memory_order_relaxed) && !loop.rejected) {
+    fn = compile(offset);
+    loop.rejected = !fn;
+    loop.fn.store(fn, std::memory_order_release);
+  }
+  return loop.fn.load(std::memory_order_relaxed);
+}
+
+LoopFn Tier::compile(size_t offset) {
+  int line = chunk.lines[offset];
+#ifdef JIT_X86_64
+  Translator t(chunk);
+  if (!t.translate(offset)) {
+    if (log)
+      IO::errorf("[jit] line %d: loop not compiled, uses %s\n", line,
+                 t.reason.c_str());
+    return nullptr;
+  }
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t size = (t.code.size() + page - 1) / page * page;
+  void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED)
+    return nullptr;
+  memcpy(mem, t.code.data(), t.code.size());
+  if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(mem, size);
+    return nullptr;
+  }
+  buffers.push_back({mem, size});
+  if (log)
+    IO::errorf("[jit] line %d: compiled loop, %zu bytes\n", line,
+               t.code.size());
+  return (LoopFn)mem;
+#else
+  if (log)
+    IO::errorf("[jit] line %d: loop not compiled, no code generator for "
+               "this platform\n",
+               line);
+  return nullptr;
+#endif
+}
+
+} // namespace Jit
@@ -0,0 +1,61 @@
+#ifndef JIT_H_
+#define JIT_H_
+
+#include "compiler.h"
+#include "interpreter.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Second execution tier of the VM. Counts the iterations each for loop runs
+// and, once a loop is hot, translates its bytecode from FOR_PREP to the end
+// of FOR_LOOP into x86-64 machine code in an mmap'd buffer. Only loops that
+// touch nothing but int and bool variables and arithmetic are compiled;
+// anything else (print, read, assert, strings) keeps running in the VM.
+namespace Jit {
+
+// Runs a compiled loop given the variable slots and the two bounds the VM
+// had on its stack. Returns -1 when the loop finished, or the code offset of
+// a division by zero.
+typedef int64_t (*LoopFn)(Runtime::Value *slots, int32_t from, int32_t to);
+
+// A tier belongs to one chunk and can outlive a run of it, so that loops
+// entered by many short runs still become hot. Runs on several threads may
+// share it.
+class Tier {
+public:
+  Tier(const Compiler::Chunk &chunk, Interpreter::JitMode mode, bool log);
+  ~Tier();
+  Tier(const Tier &) = delete;
+  Tier &operator=(const Tier &) = delete;
+
+  // Native code for the loop whose FOR_PREP is at offset if it is, or has
+  // just become, hot; nullptr if the loop is to be interpreted
+  LoopFn enter(size_t offset, int32_t from, int32_t to);
+
+private:
+  struct Loop {
+    std::atomic<LoopFn> fn{nullptr};
+    std::atomic<int64_t> iterations{0};
+    std::atomic<bool> rejected{false};
+  };
+
+  const Compiler::Chunk &chunk;
+  Interpreter::JitMode mode;
+  bool log;
+  // Every loop of the chunk, by the offset of its FOR_PREP. Filled in by
+  // the constructor, so lookups need no lock.
+  std::unordered_map<size_t, Loop> loops;
+  // Held while a loop is compiled; guards buffers
+  std::mutex compiling;
+  // Executable mappings and their sizes
+  std::vector<std::pair<void *, size_t>> buffers;
+
+  LoopFn compile(size_t offset);
+};
+
+} // namespace Jit
+
+#endif // JIT_H_
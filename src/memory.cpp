@@ -0,0 +1,66 @@
+#include "memory.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace Memory {
+
+// Incremented by the replacement operator new of the executable (new.cpp)
+// while tracking is on; stays 0 when the library is linked into a program
+// of its own. The flag is only read on the allocation path, so it never
+// leaves the caches of the threads that allocate.
+std::atomic<bool> trackingAllocations{false};
+alignas(64) std::atomic<size_t> allocationCount{0};
+
+size_t allocations() {
+  return allocationCount.load(std::memory_order_relaxed);
+}
+
+void trackAllocations(bool on) {
+  trackingAllocations.store(on, std::memory_order_relaxed);
+}
+
+static const size_t BLOCK_SIZE = 64 * 1024;
+
+void *Arena::allocate(size_t size, size_t align) {
+  uintptr_t p = ((uintptr_t)current + align - 1) & ~(uintptr_t)(align - 1);
+  if (!current || p + size > (uintptr_t)end) {
+    // Oversized requests get a block of their own
+    size_t blockSize = size + align > BLOCK_SIZE ? size + align : BLOCK_SIZE;
+    char *block = (char *)std::malloc(blockSize);
+    if (!block)
+      throw std::bad_alloc();
+    blocks.push_back(block);
+    current = block;
+    end = block + blockSize;
+    if (blocks.size() == 1)
+      firstEnd = end;
+    p = ((uintptr_t)current + align - 1) & ~(uintptr_t)(align - 1);
+  }
+  current = (char *)(p + size);
+  bytesUsed += size;
+  return (void *)p;
+}
+
+void Arena::release() {
+  for (char *block : blocks)
+    std::free(block);
+  blocks.clear();
+  current = nullptr;
+  end = nullptr;
+  bytesUsed = 0;
+}
+
+void Arena::reset() {
+  if (blocks.empty())
+    return;
+  for (size_t i = 1; i < blocks.size(); i++)
+    std::free(blocks[i]);
+  blocks.resize(1);
+  current = blocks[0];
+  end = firstEnd;
+  bytesUsed = 0;
+}
+
+} // namespace Memory
@@ -0,0 +1,61 @@
+#ifndef MEMORY_H_
+#define MEMORY_H_
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Memory {
+
+// Number of global operator new calls while tracking was on. Only counted
+// in the mini-pl executable, which replaces operator new, and off by default
+// because the shared counter contends between threads.
+size_t allocations();
+void trackAllocations(bool on);
+
+// Bump allocator for objects that share one lifetime, such as the nodes of
+// a syntax tree. Objects are never destroyed individually; release() frees
+// every block at once.
+class Arena {
+public:
+  Arena() = default;
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  ~Arena() { release(); }
+
+  void *allocate(size_t size, size_t align = alignof(std::max_align_t));
+
+  template <typename T, typename... Args> T *make(Args &&...args) {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "Arena objects are released without running destructors");
+    return new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+  }
+
+  template <typename T> T *makeArray(size_t n) {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "Arena objects are released without running destructors");
+    return static_cast<T *>(allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void release();
+  // Frees every block but the first, which is reused for the next objects.
+  // Cheaper than release() for an arena that is refilled over and over.
+  void reset();
+  // Bytes handed out since the last release
+  size_t used() const { return bytesUsed; }
+
+private:
+  std::vector<char *> blocks;
+  char *current = nullptr;
+  char *end = nullptr;
+  // End of blocks[0]
+  char *firstEnd = nullptr;
+  size_t bytesUsed = 0;
+};
+
+} // namespace Memory
+
+#endif // MEMORY_H_
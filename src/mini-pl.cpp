@@ -1,70 +1,139 @@
+#include "aot.h"
+#include "batch.h"
+#include "cache.h"
 #include "compiler.h"
 #include "interpreter.h"
+#include "io.h"
+#include "memory.h"
+#include "vm.h"
+#include <algorithm>
 #include <cerrno>
-#include <fstream>
+#include <cstdlib>
 #include <iostream>
 #include <string>
+#include <thread>
 
 using namespace std;
 
-std::string read_file(string path) {
-  std::ifstream in(path, std::ios::in | std::ios::binary);
-  if (in) {
-    std::string contents;
-    in.seekg(0, std::ios::end);
-    contents.resize(in.tellg());
-    in.seekg(0, std::ios::beg);
-    in.read(&contents[0], contents.size());
-    in.close();
-    return (contents);
+static bool endsWith(const string &s, const string &suffix) {
+  return s.size() >= suffix.size() &&
+         s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Runs a program stored by --precompile
+static int runPrecompiled(string path, const Interpreter::Options &options) {
+  Compiler::Chunk chunk;
+  if (!Cache::load(path, 0, &chunk)) {
+    cerr << "Invalid or outdated precompiled program: " << path << endl;
+    return 1;
   }
-  throw(errno);
+  return Interpreter::exitStatus(VM::run(chunk, options));
 }
 
-static int runFile(string path) {
-  string source;
-  try {
-    source = read_file(path);
-  } catch (int e) {
+static int runFile(string path, const Interpreter::Options &options) {
+  if (endsWith(path, ".mplc"))
+    return runPrecompiled(path, options);
+  IO::MappedFile source;
+  if (!source.open(path)) {
     cerr << "Failed to read file: " << path << endl;
     return errno;
   }
-  Interpreter::interpret(source);
-  return errno;
+  return Interpreter::exitStatus(
+      Interpreter::interpret(source.text(), options));
 }
 
 static int runScanner(string path) {
-  string source;
-  try {
-    source = read_file(path);
-  } catch (int e) {
+  IO::MappedFile source;
+  if (!source.open(path)) {
+    cerr << "Failed to read file: " << path << endl;
+    return errno;
+  }
+  Compiler::runScanner(source.text());
+  return errno;
+}
+
+static int benchScanner(string path) {
+  IO::MappedFile source;
+  if (!source.open(path)) {
+    cerr << "Failed to read file: " << path << endl;
+    return errno;
+  }
+  Compiler::benchScanner(source.text());
+  return errno;
+}
+
+static int runParser(string path, bool optimize) {
+  IO::MappedFile source;
+  if (!source.open(path)) {
+    cerr << "Failed to read file: " << path << endl;
+    return errno;
+  }
+  Compiler::runParser(source.text(), optimize);
+  return errno;
+}
+
+static int runCompiler(string path, bool optimize) {
+  IO::MappedFile source;
+  if (!source.open(path)) {
     cerr << "Failed to read file: " << path << endl;
     return errno;
   }
-  Compiler::runScanner(source);
+  Compiler::runCompiler(source.text(), optimize);
   return errno;
 }
 
-static int runParser(string path) {
-  string source;
-  try {
-    source = read_file(path);
-  } catch (int e) {
+static int runFlat(string path, bool optimize) {
+  IO::MappedFile source;
+  if (!source.open(path)) {
     cerr << "Failed to read file: " << path << endl;
     return errno;
   }
-  Compiler::runParser(source);
+  Compiler::runFlat(source.text(), optimize);
   return errno;
 }
 
+static int runAot(string path, string output, bool optimize) {
+  IO::MappedFile source;
+  if (!source.open(path)) {
+    cerr << "Failed to read file: " << path << endl;
+    return errno;
+  }
+  if (output.empty()) {
+    output = path;
+    if (endsWith(output, ".mpl"))
+      output.resize(output.size() - 4);
+    else
+      output += ".out";
+  }
+  return Aot::build(source.text(), output, optimize) ? 0 : 1;
+}
+
+static int runPrecompile(string path, string output,
+                         const Interpreter::Options &options) {
+  IO::MappedFile source;
+  if (!source.open(path)) {
+    cerr << "Failed to read file: " << path << endl;
+    return errno;
+  }
+  if (output.empty() && !options.cacheDir.empty())
+    output = Cache::path(options.cacheDir,
+                         Cache::key(source.text(), options.optimize));
+  else if (output.empty())
+    output = (endsWith(path, ".mpl") ? path.substr(0, path.size() - 4) : path) +
+             ".mplc";
+  return Cache::precompile(source.text(), output, options.optimize) ? 0 : 1;
+}
+
 static void repl() {
+  // Variables persist from one line to the next
+  Interpreter::Context context;
   string line;
   for (;;) {
     cout << "> ";
-    cin >> line;
+    getline(cin, line);
     if (cin.eof())
       break;
-    Interpreter::interpret(line);
+    Interpreter::interpret(&context, line);
   }
   cout << "\r";
 }
@@ -74,26 +143,125 @@ static void printHelp() {
   cout << "\tmini-pl \n";
   cout << "\tmini-pl -h\n";
   cout << "\tmini-pl --help\n";
-  cout << "\tmini-pl [path]\n";
+  cout << "\tmini-pl [--vm | --walker | --flat] [path]\n";
+  cout << "\tmini-pl --alloc-stats [path]\n";
+  cout << "\tmini-pl [--alloc-stats] --stream [path]\n";
+  cout << "\tmini-pl --no-optimize [-p | -b | -f] [path]\n";
+  cout << "\tmini-pl [--jit=off | --jit=force] [--jit=log] [path]\n";
+  cout << "\tmini-pl [--cache-dir dir] [path]\n";
+  cout << "\tmini-pl [--output-buffer bytes] [--line-buffered] [path]\n";
+  cout << "\tmini-pl [--input file] [path]\n";
+  cout << "\tmini-pl [--cache-dir dir] --precompile [path] [-o output]\n";
+  cout << "\tmini-pl [path.mplc]\n";
+  cout << "\tmini-pl [--no-optimize] -c [path] [-o output]\n";
+  cout << "\tmini-pl [--vm | --walker | --flat] --batch [dir] [-j threads]\n";
+  cout << "\tmini-pl -s [path]\n";
+  cout << "\tmini-pl --bench-scan [path]\n";
+  cout << "\tmini-pl -p [path]\n";
+  cout << "\tmini-pl -b [path]\n";
+  cout << "\tmini-pl -f [path]\n";
 }
 
 int main(int argc, char *argv[]) {
   if (argc == 1)
     repl();
   else if (argc >= 2) {
-    string arg1 = argv[1];
+    Interpreter::Options options;
+    options.backend = Interpreter::Backend::VM;
+    string inputPath = "-";
+    size_t outputBuffer = IO::DEFAULT_OUTPUT_BUFFER;
+    bool lineBuffered = false;
+    int i = 1;
+    for (; i < argc - 1; i++) {
+      string flag = argv[i];
+      if (flag.compare("--vm") == 0)
+        options.backend = Interpreter::Backend::VM;
+      else if (flag.compare("--walker") == 0)
+        options.backend = Interpreter::Backend::WALKER;
+      else if (flag.compare("--flat") == 0)
+        options.backend = Interpreter::Backend::FLAT;
+      else if (flag.compare("--alloc-stats") == 0) {
+        options.backend = Interpreter::Backend::WALKER;
+        options.allocStats = true;
+        Memory::trackAllocations(true);
+      } else if (flag.compare("--stream") == 0) {
+        options.backend = Interpreter::Backend::WALKER;
+        options.stream = true;
+      } else if (flag.compare("--no-optimize") == 0)
+        options.optimize = false;
+      else if (flag.compare("--jit=off") == 0)
+        options.jit = Interpreter::JitMode::OFF;
+      else if (flag.compare("--jit=force") == 0)
+        options.jit = Interpreter::JitMode::FORCE;
+      else if (flag.compare("--jit=log") == 0)
+        options.jitLog = true;
+      else if (flag.compare("--cache-dir") == 0 && i + 2 < argc)
+        options.cacheDir = argv[++i];
+      else if (flag.compare("--output-buffer") == 0 && i + 2 < argc)
+        outputBuffer = std::max(1L, atol(argv[++i]));
+      else if (flag.compare("--line-buffered") == 0)
+        lineBuffered = true;
+      else if (flag.compare("--input") == 0 && i + 2 < argc)
+        inputPath = argv[++i];
+      else
+        break;
+    }
+    string arg1 = argv[i];
     if (arg1.compare("-h") == 0)
       goto end; // ↑_(ΦwΦ;)Ψ there is no help
     if (arg1.compare("--help") == 0)
       goto end; // (｀㊥益㊥)Ψ
-    if (arg1.compare("-s") == 0) {
-      string arg2 = argv[2];
+    if (i + 1 < argc && arg1.compare("-s") == 0) {
+      string arg2 = argv[i + 1];
       runScanner(arg2);
-    } else if (arg1.compare("-p") == 0) {
-      string arg2 = argv[2];
-      runParser(arg2);
-    } else
-      return runFile(arg1);
+    } else if (i + 1 < argc && arg1.compare("--bench-scan") == 0) {
+      string arg2 = argv[i + 1];
+      benchScanner(arg2);
+    } else if (i + 1 < argc && arg1.compare("-p") == 0) {
+      string arg2 = argv[i + 1];
+      runParser(arg2, options.optimize);
+    } else if (i + 1 < argc && arg1.compare("-b") == 0) {
+      string arg2 = argv[i + 1];
+      runCompiler(arg2, options.optimize);
+    } else if (i + 1 < argc && arg1.compare("-f") == 0) {
+      string arg2 = argv[i + 1];
+      runFlat(arg2, options.optimize);
+    } else if (i + 1 < argc && arg1.compare("--batch") == 0) {
+      string dir = argv[i + 1];
+      unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+      if (i + 3 < argc && string(argv[i + 2]).compare("-j") == 0)
+        threads = std::max(1, atoi(argv[i + 3]));
+      else if (i + 2 < argc)
+        goto end;
+      return Batch::run(dir, threads, options) == 0 ? 0 : 1;
+    } else if (i + 1 < argc && arg1.compare("--precompile") == 0) {
+      string arg2 = argv[i + 1];
+      string output;
+      if (i + 3 < argc && string(argv[i + 2]).compare("-o") == 0)
+        output = argv[i + 3];
+      else if (i + 2 < argc)
+        goto end;
+      return runPrecompile(arg2, output, options);
+    } else if (i + 1 < argc && arg1.compare("-c") == 0) {
+      string arg2 = argv[i + 1];
+      string output;
+      if (i + 3 < argc && string(argv[i + 2]).compare("-o") == 0)
+        output = argv[i + 3];
+      else if (i + 2 < argc)
+        goto end;
+      return runAot(arg2, output, options.optimize);
+    } else if (arg1[0] != '-') {
+      IO::BufferedOutput output(outputBuffer, lineBuffered);
+      IO::Input input;
+      if (!input.open(inputPath)) {
+        cerr << "Failed to read file: " << inputPath << endl;
+        return errno;
+      }
+      IO::ReadFrom reading(input);
+      return runFile(arg1, options);
+    }
+    else
+      goto end;
   } else
   end:
     printHelp();
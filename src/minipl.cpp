@@ -0,0 +1,88 @@
+#include "minipl.h"
+#include "io.h"
+#include "vm.h"
+#include <sstream>
+#include <streambuf>
+
+namespace MiniPL {
+
+// Passes everything written to it straight to a host callback
+class CallbackOutput : public std::streambuf {
+public:
+  CallbackOutput(const std::function<void(const char *, size_t)> &f)
+      : write(f) {}
+
+protected:
+  std::streamsize xsputn(const char *s, std::streamsize n) override {
+    write(s, n);
+    return n;
+  }
+  int_type overflow(int_type c) override {
+    if (c != traits_type::eof()) {
+      char ch = c;
+      write(&ch, 1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+private:
+  const std::function<void(const char *, size_t)> &write;
+};
+
+// Fetches input from a host callback whenever the last piece is used up
+class CallbackInput : public std::streambuf {
+public:
+  CallbackInput(const std::function<bool(std::string *)> &f) : more(f) {}
+
+protected:
+  int_type underflow() override {
+    do {
+      buffer.clear();
+      if (!more(&buffer))
+        return traits_type::eof();
+    } while (buffer.empty());
+    setg(&buffer[0], &buffer[0], &buffer[0] + buffer.size());
+    return traits_type::to_int_type(buffer[0]);
+  }
+
+private:
+  const std::function<bool(std::string *)> &more;
+  std::string buffer;
+};
+
+std::unique_ptr<const Program>
+Program::compile(std::string_view source, std::string *errors,
+                 const Interpreter::Options &options) {
+  std::ostringstream err;
+  Parser::Program program;
+  Resolver::Symbols symbols;
+  bool ok;
+  {
+    IO::Redirect redirect(IO::in(), IO::out(), errors ? err : IO::err());
+    ok = Compiler::analyze(source, &program, &symbols, options.optimize);
+  }
+  if (errors)
+    *errors = err.str();
+  if (!ok)
+    return nullptr;
+  std::unique_ptr<Program> p(new Program);
+  p->options = options;
+  p->options.backend = Interpreter::Backend::VM;
+  Compiler::compile(program.stmts, symbols, &p->code);
+  if (options.jit != Interpreter::JitMode::OFF)
+    p->tier.reset(new Jit::Tier(p->code, options.jit, options.jitLog));
+  return std::unique_ptr<const Program>(std::move(p));
+}
+
+Interpreter::InterpretResult Program::run(const Host &host) const {
+  CallbackOutput outBuf(host.print), errBuf(host.error);
+  CallbackInput inBuf(host.read);
+  std::ostream out(&outBuf), err(&errBuf);
+  std::istream in(&inBuf);
+  IO::Redirect redirect(host.read ? in : IO::in(),
+                        host.print ? out : IO::out(),
+                        host.error ? err : IO::err());
+  return VM::run(code, options, tier.get());
+}
+
+} // namespace MiniPL
@@ -0,0 +1,54 @@
+#ifndef MINIPL_H_
+#define MINIPL_H_
+
+#include "compiler.h"
+#include "interpreter.h"
+#include "jit.h"
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Public API of libminipl for embedding the language: a program is compiled
+// once and can then be run any number of times, from any number of threads,
+// each run starting with fresh variables.
+namespace MiniPL {
+
+// Connects a run to its host. Callbacks that are not set fall back to the
+// standard streams.
+struct Host {
+  // Receives everything the program prints, including assert diagnostics
+  std::function<void(const char *text, size_t length)> print;
+  // Supplies more input for read statements, which take whitespace-separated
+  // words from it. Returns false at end of input.
+  std::function<bool(std::string *more)> read;
+  // Receives runtime error messages
+  std::function<void(const char *text, size_t length)> error;
+};
+
+class Program {
+public:
+  // Compiles source to bytecode. Returns null if it has errors, which are
+  // stored in errors if given. options.backend is ignored.
+  static std::unique_ptr<const Program>
+  compile(std::string_view source, std::string *errors = nullptr,
+          const Interpreter::Options &options = Interpreter::Options());
+
+  Interpreter::InterpretResult run(const Host &host = Host()) const;
+
+  const Compiler::Chunk &chunk() const { return code; }
+
+private:
+  Program() = default;
+
+  Compiler::Chunk code;
+  Interpreter::Options options;
+  // Shared by all runs, so that loops get hot over many short runs; null if
+  // the JIT is off
+  std::unique_ptr<Jit::Tier> tier;
+};
+
+} // namespace MiniPL
+
+#endif // MINIPL_H_
@@ -0,0 +1,27 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace Memory {
+// Defined in memory.cpp
+extern std::atomic<bool> trackingAllocations;
+extern std::atomic<size_t> allocationCount;
+} // namespace Memory
+
+// Counting replacements for the global allocation functions; the shared
+// counter is only touched while --alloc-stats tracks allocations. The array
+// and nothrow forms are forwarded here by the standard library. This file is
+// only linked into the mini-pl executable; the library leaves the allocation
+// functions of the program embedding it alone.
+void *operator new(size_t size) {
+  if (Memory::trackingAllocations.load(std::memory_order_relaxed))
+    Memory::allocationCount.fetch_add(1, std::memory_order_relaxed);
+  void *p = std::malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
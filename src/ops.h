@@ -0,0 +1,109 @@
+#ifndef OPS_H_
+#define OPS_H_
+
+#include "scanner.h"
+#include "value.h"
+#include <array>
+
+namespace Runtime {
+
+typedef Value (*OpFn)(const Value &l, const Value &r);
+
+namespace Ops {
+
+// Integer arithmetic wraps around in two's complement, like the C
+// translation built with -fwrapv. Signed overflow is undefined in C++, so
+// it is done on unsigned values.
+inline int32_t add(int32_t l, int32_t r) {
+  return (int32_t)((uint32_t)l + (uint32_t)r);
+}
+inline int32_t subtract(int32_t l, int32_t r) {
+  return (int32_t)((uint32_t)l - (uint32_t)r);
+}
+inline int32_t multiply(int32_t l, int32_t r) {
+  return (int32_t)((uint32_t)l * (uint32_t)r);
+}
+inline Value addInt(const Value &l, const Value &r) {
+  return Value::integer(add(l.getInt(), r.getInt()));
+}
+inline Value concat(const Value &l, const Value &r) {
+  return Value::concat(l, r);
+}
+inline Value sub(const Value &l, const Value &r) {
+  return Value::integer(subtract(l.getInt(), r.getInt()));
+}
+inline Value mul(const Value &l, const Value &r) {
+  return Value::integer(multiply(l.getInt(), r.getInt()));
+}
+// Quotient of l and a nonzero r, which the backends check for first. The
+// one quotient out of range, INT32_MIN / -1, wraps around to INT32_MIN like
+// the results of the other int operators.
+inline int32_t divide(int32_t l, int32_t r) {
+  return r == -1 ? (int32_t)(0u - (uint32_t)l) : l / r;
+}
+inline Value div(const Value &l, const Value &r) {
+  return Value::integer(divide(l.getInt(), r.getInt()));
+}
+inline Value andBool(const Value &l, const Value &r) {
+  return Value::boolean(l.getBool() && r.getBool());
+}
+inline Value equalInt(const Value &l, const Value &r) {
+  return Value::boolean(l.getInt() == r.getInt());
+}
+inline Value equalBool(const Value &l, const Value &r) {
+  return Value::boolean(l.getBool() == r.getBool());
+}
+inline Value equalString(const Value &l, const Value &r) {
+  return Value::boolean(l.getString() == r.getString());
+}
+inline Value lessInt(const Value &l, const Value &r) {
+  return Value::boolean(l.getInt() < r.getInt());
+}
+inline Value lessBool(const Value &l, const Value &r) {
+  return Value::boolean(l.getBool() < r.getBool());
+}
+inline Value lessString(const Value &l, const Value &r) {
+  return Value::boolean(l.getString() < r.getString());
+}
+// Ignores left
+inline Value notBool(const Value &l, const Value &r) {
+  return Value::boolean(!r.getBool());
+}
+
+constexpr int TYPE_COUNT = 3;
+typedef std::array<std::array<OpFn, TYPE_COUNT>, Scanner::TOKEN_COUNT> Table;
+
+constexpr Table makeTable() {
+  Table t{};
+  auto set = [&t](Scanner::TokenType op, ValueType type, OpFn fn) {
+    t[(int)op][(int)type] = fn;
+  };
+  set(Scanner::TokenType::PLUS, ValueType::INT, addInt);
+  set(Scanner::TokenType::PLUS, ValueType::STRING, concat);
+  set(Scanner::TokenType::MINUS, ValueType::INT, sub);
+  set(Scanner::TokenType::ASTERISK, ValueType::INT, mul);
+  set(Scanner::TokenType::SLASH, ValueType::INT, div);
+  set(Scanner::TokenType::AND, ValueType::BOOL, andBool);
+  set(Scanner::TokenType::EQUAL, ValueType::INT, equalInt);
+  set(Scanner::TokenType::EQUAL, ValueType::BOOL, equalBool);
+  set(Scanner::TokenType::EQUAL, ValueType::STRING, equalString);
+  set(Scanner::TokenType::LESS, ValueType::INT, lessInt);
+  set(Scanner::TokenType::LESS, ValueType::BOOL, lessBool);
+  set(Scanner::TokenType::LESS, ValueType::STRING, lessString);
+  set(Scanner::TokenType::NOT, ValueType::BOOL, notBool);
+  return t;
+}
+
+// Kernels by operator token and operand type, built at compile time. Entries
+// the checker rejects are null.
+constexpr Table table = makeTable();
+
+} // namespace Ops
+
+inline OpFn getOp(Scanner::TokenType op, ValueType type) {
+  return Ops::table[(int)op][(int)type];
+}
+
+} // namespace Runtime
+
+#endif // OPS_H_
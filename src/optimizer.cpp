@@ -0,0 +1,703 @@
+#include "optimizer.h"
+#include "ops.h"
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace Optimizer {
+
+using Runtime::Value;
+using Runtime::ValueType;
+using Scanner::TokenType;
+
+template <typename T> static T *mut(const T *n) { return const_cast<T *>(n); }
+
+// Value of a literal, looking through parentheses
+static bool constant(const Parser::Opnd *o, Value *v) {
+  while (auto *s = dynamic_cast<const Parser::Single *>(o))
+    o = s->right;
+  if (auto *i = dynamic_cast<const Parser::Int *>(o))
+    *v = Value::integer(i->number());
+  else if (auto *b = dynamic_cast<const Parser::Bool *>(o))
+    *v = Value::boolean(b->value.start[0] == 't');
+  else if (auto *s = dynamic_cast<const Parser::String *>(o))
+    *v = Value::string(std::string(s->text));
+  else
+    return false;
+  return true;
+}
+
+static const char *copy(Memory::Arena &arena, const char *s, size_t length) {
+  char *c = arena.makeArray<char>(length);
+  memcpy(c, s, length);
+  return c;
+}
+
+// Makes a literal node for v with its text in the arena
+static Parser::Opnd *literal(Memory::Arena &arena, const Value &v,
+                             Scanner::Token at) {
+  Scanner::Token t = at;
+  t.message = nullptr;
+  Parser::Opnd *o;
+  if (v.type == ValueType::INT) {
+    char buf[16];
+    t.type = TokenType::INTEGER_LIT;
+    t.length = snprintf(buf, sizeof buf, "%d", v.getInt());
+    t.start = copy(arena, buf, t.length);
+    o = arena.make<Parser::Int>(t);
+  } else if (v.type == ValueType::BOOL) {
+    t.type = TokenType::BOOLEAN_LIT;
+    t.start = v.getBool() ? "true" : "false";
+    t.length = strlen(t.start);
+    o = arena.make<Parser::Bool>(t);
+  } else {
+    // The token is what -p prints, so it is escaped again
+    std::string_view s = v.getString();
+    std::string quoted = "\"";
+    for (char c : s) {
+      if (c == '\n')
+        quoted += "\\n";
+      else if (c == '\t')
+        quoted += "\\t";
+      else if (c == '\\' || c == '"')
+        quoted += {'\\', c};
+      else
+        quoted += c;
+    }
+    quoted += '"';
+    t.type = TokenType::STRING_LIT;
+    t.length = quoted.size();
+    t.start = copy(arena, quoted.data(), t.length);
+    o = arena.make<Parser::String>(
+        t, std::string_view(copy(arena, s.data(), s.size()), s.size()));
+  }
+  o->type = v.type;
+  return o;
+}
+
+// Statements hold expressions, so a bare operand is wrapped in a Single
+static Parser::Expr *wrap(Memory::Arena &arena, Parser::Opnd *o) {
+  if (auto *e = dynamic_cast<Parser::Expr *>(o))
+    return e;
+  Parser::Single *s = arena.make<Parser::Single>(o);
+  s->type = o->type;
+  return s;
+}
+
+
+// Folds expressions bottom up. Expressions push their folded form on results;
+// statements leave their replacement in stmt, or nullptr if they are dropped.
+class FoldWalker : public Parser::ExprWalker {
+public:
+  Memory::Arena &arena;
+  std::vector<Parser::Opnd *> results;
+  Parser::Stmt *stmt = nullptr;
+
+  FoldWalker(Memory::Arena &a) : arena(a) {}
+
+  void visitOpnd(const Parser::Opnd *o) override { results.push_back(mut(o)); }
+  void visitInt(const Parser::Int *i) override { results.push_back(mut(i)); }
+  void visitBool(const Parser::Bool *b) override { results.push_back(mut(b)); }
+  void visitString(const Parser::String *s) override {
+    results.push_back(mut(s));
+  }
+  void visitIdent(const Parser::Ident *i) override {
+    results.push_back(mut(i));
+  }
+  void visitExpr(const Parser::Expr *e) override { results.push_back(mut(e)); }
+  void visitBinary(const Parser::Binary *b) override {
+    Parser::Binary *n = mut(b);
+    n->right = take();
+    n->left = take();
+    results.push_back(n);
+    Value l, r;
+    if (!constant(n->left, &l) || !constant(n->right, &r))
+      return;
+    ValueType type = n->left->type;
+    // Division by zero is left to fail at run time
+    if (n->op.type == TokenType::SLASH && r.getInt() == 0)
+      return;
+    Runtime::OpFn fn = Runtime::getOp(n->op.type, type);
+    if (fn)
+      results.back() = literal(arena, fn(l, r), n->op);
+  }
+  void visitUnary(const Parser::Unary *u) override {
+    Parser::Unary *n = mut(u);
+    n->right = take();
+    results.push_back(n);
+    Value r;
+    if (!constant(n->right, &r))
+      return;
+    Runtime::OpFn fn = Runtime::getOp(n->op.type, n->right->type);
+    if (fn)
+      results.back() = literal(arena, fn(r, r), n->op);
+  }
+  void visitSingle(const Parser::Single *s) override {
+    Parser::Single *n = mut(s);
+    n->right = take();
+    Value v;
+    results.push_back(constant(n->right, &v) ? n->right : n);
+  }
+  void visitStmt(const Parser::Stmt *s) override { stmt = mut(s); }
+  void visitStmts(const Parser::Stmts *s) override {
+    Parser::NodeList kept;
+    for (Parser::TreeNode *n : s->stmts) {
+      n->accept(this);
+      if (stmt)
+        kept.push_back(arena, stmt);
+    }
+    mut(s)->stmts = kept;
+  }
+  void visitVar(const Parser::Var *v) override {
+    Parser::Var *n = mut(v);
+    if (n->expr)
+      n->expr = foldExpr(n->expr);
+    stmt = n;
+  }
+  void visitAssign(const Parser::Assign *a) override {
+    Parser::Assign *n = mut(a);
+    n->expr = foldExpr(n->expr);
+    stmt = n;
+  }
+  void visitFor(const Parser::For *f) override {
+    Parser::For *n = mut(f);
+    n->from = foldExpr(n->from);
+    n->to = foldExpr(n->to);
+    n->body->accept(this);
+    stmt = n;
+    Value from, to;
+    if (constant(n->from, &from) && constant(n->to, &to) &&
+        from.getInt() > to.getInt()) {
+      // The body never runs but the control variable still gets the start
+      Parser::Assign *a = arena.make<Parser::Assign>(n->ident, n->from);
+      a->slot = n->slot;
+      stmt = a;
+    }
+  }
+  void visitRead(const Parser::Read *r) override { stmt = mut(r); }
+  void visitPrint(const Parser::Print *p) override {
+    Parser::Print *n = mut(p);
+    n->expr = foldExpr(n->expr);
+    stmt = n;
+  }
+  void visitAssert(const Parser::Assert *a) override {
+    Parser::Assert *n = mut(a);
+    n->expr = foldExpr(n->expr);
+    Value v;
+    stmt = constant(n->expr, &v) && v.getBool() ? nullptr : n;
+  }
+
+private:
+  Parser::Opnd *take() {
+    Parser::Opnd *o = results.back();
+    results.pop_back();
+    return o;
+  }
+
+  Parser::Opnd *fold(Parser::Opnd *o) {
+    walkExpr(o);
+    return take();
+  }
+
+  Parser::Expr *foldExpr(Parser::Expr *e) {
+    Parser::Opnd *o = fold(e);
+    // A Single keeps the folded operand
+    if (dynamic_cast<Parser::Single *>(e))
+      return e;
+    return wrap(arena, o);
+  }
+};
+
+// Strips parentheses
+static const Parser::Opnd *strip(const Parser::Opnd *o) {
+  while (auto *s = dynamic_cast<const Parser::Single *>(o))
+    o = s->right;
+  return o;
+}
+
+static Parser::Opnd *strip(Parser::Opnd *o) {
+  return mut(strip(static_cast<const Parser::Opnd *>(o)));
+}
+
+static bool isControl(const Parser::Opnd *o, int slot) {
+  auto *i = dynamic_cast<const Parser::Ident *>(strip(o));
+  return i && i->slot == slot;
+}
+
+// Variables written by a statement, including those of nested loops
+static void collectWrites(const Parser::TreeNode *n,
+                          std::unordered_set<int> *writes) {
+  if (auto *v = dynamic_cast<const Parser::Var *>(n))
+    writes->insert(v->slot);
+  else if (auto *a = dynamic_cast<const Parser::Assign *>(n))
+    writes->insert(a->slot);
+  else if (auto *r = dynamic_cast<const Parser::Read *>(n))
+    writes->insert(r->slot);
+  else if (auto *f = dynamic_cast<const Parser::For *>(n)) {
+    writes->insert(f->slot);
+    for (uint32_t i = 0; i < f->inductionCount; i++)
+      writes->insert(f->inductions[i].slot);
+    for (Parser::TreeNode *t : f->body->stmts)
+      collectWrites(t, writes);
+  }
+}
+
+// Leaf that does not change while the loop writing writes runs
+static bool invariantLeaf(const Parser::Opnd *o,
+                          const std::unordered_set<int> &writes) {
+  if (auto *i = dynamic_cast<const Parser::Ident *>(o))
+    return !writes.count(i->slot);
+  return dynamic_cast<const Parser::Int *>(o) ||
+         dynamic_cast<const Parser::Bool *>(o) ||
+         dynamic_cast<const Parser::String *>(o);
+}
+
+// Node whose own operation can not fail
+static bool safeNode(const Parser::Opnd *o) {
+  auto *b = dynamic_cast<const Parser::Binary *>(o);
+  Value r;
+  return !b || b->op.type != TokenType::SLASH ||
+         (constant(b->right, &r) && r.getInt() != 0);
+}
+
+// True if pred holds for every node of o. Walks an explicit stack, as
+// expressions can be too deep to recurse over.
+template <typename P> static bool all(const Parser::Opnd *o, P pred) {
+  std::vector<const Parser::Opnd *> todo{o};
+  while (!todo.empty()) {
+    const Parser::Opnd *n = todo.back();
+    todo.pop_back();
+    if (!pred(n))
+      return false;
+    if (n->arity > 0) {
+      auto *e = static_cast<const Parser::Expr *>(n);
+      todo.push_back(e->right);
+      if (n->arity == 2)
+        todo.push_back(e->left);
+    }
+  }
+  return true;
+}
+
+static bool invariant(const Parser::Opnd *o,
+                      const std::unordered_set<int> &writes) {
+  return all(o, [&writes](const Parser::Opnd *n) {
+    return n->arity > 0 || invariantLeaf(n, writes);
+  });
+}
+
+// Applies fn to the expressions of a statement, not including loop bodies.
+// fn returns the expression to store back.
+template <typename F> static void forEachExpr(Parser::TreeNode *t, F fn) {
+  if (auto *v = dynamic_cast<Parser::Var *>(t)) {
+    if (v->expr)
+      v->expr = fn(v->expr);
+  } else if (auto *a = dynamic_cast<Parser::Assign *>(t))
+    a->expr = fn(a->expr);
+  else if (auto *p = dynamic_cast<Parser::Print *>(t))
+    p->expr = fn(p->expr);
+  else if (auto *a = dynamic_cast<Parser::Assert *>(t))
+    a->expr = fn(a->expr);
+  else if (auto *f = dynamic_cast<Parser::For *>(t)) {
+    f->from = fn(f->from);
+    f->to = fn(f->to);
+  }
+}
+
+static size_t countStmts(const Parser::Stmts *s) {
+  size_t n = 0;
+  for (Parser::TreeNode *t : s->stmts) {
+    n++;
+    if (auto *f = dynamic_cast<const Parser::For *>(t))
+      n += countStmts(f->body);
+  }
+  return n;
+}
+
+static Parser::Ident *ident(Memory::Arena &arena, Scanner::Token t, int slot) {
+  Parser::Ident *i = arena.make<Parser::Ident>(t);
+  i->slot = slot;
+  return i;
+}
+
+// Copies a loop body for unrolling, with the control variable replaced by
+// its value in that iteration
+class CloneWalker : public Parser::ExprWalker {
+public:
+  Memory::Arena &arena;
+  int slot;
+  Value value;
+  std::vector<Parser::Opnd *> results;
+  Parser::Stmt *stmt = nullptr;
+
+  CloneWalker(Memory::Arena &a, int s, int32_t v) : arena(a), slot(s) {
+    value = Value::integer(v);
+  }
+
+  void visitOpnd(const Parser::Opnd *o) override { results.push_back(mut(o)); }
+  void visitInt(const Parser::Int *i) override { results.push_back(mut(i)); }
+  void visitBool(const Parser::Bool *b) override { results.push_back(mut(b)); }
+  void visitString(const Parser::String *s) override {
+    results.push_back(mut(s));
+  }
+  void visitIdent(const Parser::Ident *i) override {
+    results.push_back(i->slot == slot ? literal(arena, value, i->ident)
+                                      : mut(i));
+  }
+  void visitExpr(const Parser::Expr *e) override { results.push_back(mut(e)); }
+  void visitBinary(const Parser::Binary *b) override {
+    Parser::Binary *n = arena.make<Parser::Binary>(*b);
+    n->right = take();
+    n->left = take();
+    results.push_back(n);
+  }
+  void visitUnary(const Parser::Unary *u) override {
+    Parser::Unary *n = arena.make<Parser::Unary>(*u);
+    n->right = take();
+    results.push_back(n);
+  }
+  void visitSingle(const Parser::Single *s) override {
+    Parser::Single *n = arena.make<Parser::Single>(*s);
+    n->right = take();
+    results.push_back(n);
+  }
+  void visitStmt(const Parser::Stmt *s) override { stmt = mut(s); }
+  void visitStmts(const Parser::Stmts *s) override {}
+  void visitVar(const Parser::Var *v) override {
+    Parser::Var *n = arena.make<Parser::Var>(*v);
+    if (v->expr)
+      n->expr = cloneExpr(v->expr);
+    stmt = n;
+  }
+  void visitAssign(const Parser::Assign *a) override {
+    Parser::Assign *n = arena.make<Parser::Assign>(*a);
+    n->expr = cloneExpr(a->expr);
+    stmt = n;
+  }
+  // Bodies with nested loops are not unrolled
+  void visitFor(const Parser::For *f) override { stmt = mut(f); }
+  void visitRead(const Parser::Read *r) override { stmt = mut(r); }
+  void visitPrint(const Parser::Print *p) override {
+    Parser::Print *n = arena.make<Parser::Print>(*p);
+    n->expr = cloneExpr(p->expr);
+    stmt = n;
+  }
+  void visitAssert(const Parser::Assert *a) override {
+    Parser::Assert *n = arena.make<Parser::Assert>(*a);
+    n->expr = cloneExpr(a->expr);
+    stmt = n;
+  }
+
+private:
+  Parser::Opnd *take() {
+    Parser::Opnd *o = results.back();
+    results.pop_back();
+    return o;
+  }
+
+  Parser::Opnd *clone(const Parser::Opnd *o) {
+    walkExpr(mut(o));
+    return take();
+  }
+  Parser::Expr *cloneExpr(const Parser::Expr *e) {
+    return wrap(arena, clone(e));
+  }
+};
+
+// Optimizes for loops innermost first, so that code hoisted out of an inner
+// loop can be hoisted further out of the enclosing one. Each statement
+// appends the statements that replace it to out. Hoisted values live in
+// temporaries: variables named "$tN" that the resolver never hands out.
+class LoopWalker : public Parser::TreeWalker {
+public:
+  Memory::Arena &arena;
+  Resolver::Symbols &symbols;
+  std::vector<Parser::Stmt *> out;
+
+  // Loops with at most this many iterations and statements in all are
+  // unrolled
+  static constexpr int64_t UNROLL_TRIPS = 8;
+  static constexpr size_t UNROLL_STMTS = 32;
+
+  LoopWalker(Memory::Arena &a, Resolver::Symbols &s) : arena(a), symbols(s) {}
+
+  void visitOpnd(const Parser::Opnd *o) override {}
+  void visitInt(const Parser::Int *i) override {}
+  void visitBool(const Parser::Bool *b) override {}
+  void visitString(const Parser::String *s) override {}
+  void visitIdent(const Parser::Ident *i) override {}
+  void visitExpr(const Parser::Expr *e) override {}
+  void visitBinary(const Parser::Binary *b) override {}
+  void visitUnary(const Parser::Unary *u) override {}
+  void visitSingle(const Parser::Single *s) override {}
+  void visitStmt(const Parser::Stmt *s) override { out.push_back(mut(s)); }
+  void visitStmts(const Parser::Stmts *s) override {
+    std::vector<Parser::Stmt *> outer;
+    outer.swap(out);
+    for (Parser::TreeNode *n : s->stmts)
+      n->accept(this);
+    Parser::NodeList list;
+    for (Parser::Stmt *st : out)
+      list.push_back(arena, st);
+    mut(s)->stmts = list;
+    out.swap(outer);
+  }
+  void visitVar(const Parser::Var *v) override { out.push_back(mut(v)); }
+  void visitAssign(const Parser::Assign *a) override { out.push_back(mut(a)); }
+  void visitFor(const Parser::For *f) override {
+    Parser::For *n = mut(f);
+    n->body->accept(this);
+    if (unroll(n))
+      return;
+    std::unordered_set<int> writes;
+    hoist(n, &writes);
+    reduce(n, writes);
+    out.push_back(n);
+  }
+  void visitRead(const Parser::Read *r) override { out.push_back(mut(r)); }
+  void visitPrint(const Parser::Print *p) override { out.push_back(mut(p)); }
+  void visitAssert(const Parser::Assert *a) override { out.push_back(mut(a)); }
+
+private:
+  bool isTemporary(int slot) const { return symbols.names[slot][0] == '$'; }
+
+  // Stores e in a new temporary declared in front of the loop
+  Parser::Ident *temporary(Parser::Opnd *e, Scanner::Token at) {
+    int slot = symbols.size();
+    std::string name = "$t" + std::to_string(slot);
+    symbols.names.push_back(name);
+    symbols.types.push_back(e->type);
+    Scanner::Token t = at;
+    t.type = TokenType::IDENTIFIER;
+    t.start = copy(arena, name.data(), name.size());
+    t.length = name.size();
+    Parser::Var *v = arena.make<Parser::Var>();
+    v->ident = t;
+    v->slot = slot;
+    v->type = t;
+    v->type.type = e->type == ValueType::INT    ? TokenType::INT
+                   : e->type == ValueType::BOOL ? TokenType::BOOL
+                                                : TokenType::STRING;
+    v->expr = wrap(arena, e);
+    FoldWalker fold(arena);
+    v->accept(&fold);
+    out.push_back(v);
+    Parser::Ident *i = ident(arena, t, slot);
+    i->type = e->type;
+    return i;
+  }
+
+  // Replaces a loop with a small known trip count by copies of its body
+  bool unroll(Parser::For *f) {
+    Value from, to;
+    if (!constant(f->from, &from) || !constant(f->to, &to))
+      return false;
+    int64_t trips = (int64_t)to.getInt() - from.getInt() + 1;
+    size_t size = countStmts(f->body);
+    if (trips < 1 || trips > UNROLL_TRIPS || size * trips > UNROLL_STMTS)
+      return false;
+    bool asserts = false;
+    for (Parser::TreeNode *t : f->body->stmts) {
+      if (dynamic_cast<const Parser::For *>(t))
+        return false;
+      asserts |= dynamic_cast<const Parser::Assert *>(t) != nullptr;
+    }
+    FoldWalker fold(arena);
+    // A loop up to INT32_MAX would wrap an int32_t counter around forever
+    for (int64_t i = from.getInt(); i <= to.getInt(); i++) {
+      // Only the state dump of a failed assert can see the control variable
+      if (asserts)
+        out.push_back(assign(f, (int32_t)i));
+      CloneWalker cw(arena, f->slot, (int32_t)i);
+      for (Parser::TreeNode *t : f->body->stmts) {
+        t->accept(&cw);
+        cw.stmt->accept(&fold);
+        if (fold.stmt)
+          out.push_back(fold.stmt);
+      }
+    }
+    // The control variable ends one past the end, wrapping like int +
+    out.push_back(assign(f, Runtime::Ops::add(to.getInt(), 1)));
+    return true;
+  }
+
+  Parser::Assign *assign(Parser::For *f, int32_t value) {
+    Parser::Opnd *v = literal(arena, Value::integer(value), f->ident);
+    Parser::Assign *a = arena.make<Parser::Assign>(f->ident, wrap(arena, v));
+    a->slot = f->slot;
+    return a;
+  }
+
+  // Moves computations that depend on nothing the loop writes in front of
+  // it. writes is left holding the variables the loop writes.
+  void hoist(Parser::For *f, std::unordered_set<int> *writes) {
+    writes->insert(f->slot);
+    for (Parser::TreeNode *t : f->body->stmts) {
+      auto *v = dynamic_cast<const Parser::Var *>(t);
+      if (!v || !isTemporary(v->slot))
+        collectWrites(t, writes);
+    }
+    // Temporaries hoisted out of inner loops move further out if they can.
+    // Induction variables of inner loops are in writes and stay.
+    Parser::NodeList kept;
+    for (Parser::TreeNode *t : f->body->stmts) {
+      auto *v = dynamic_cast<Parser::Var *>(t);
+      if (v && isTemporary(v->slot) && !writes->count(v->slot)) {
+        if (invariant(v->expr, *writes)) {
+          out.push_back(v);
+          continue;
+        }
+        writes->insert(v->slot);
+      }
+      kept.push_back(arena, t);
+    }
+    f->body->stmts = kept;
+    for (Parser::TreeNode *t : f->body->stmts)
+      forEachExpr(t, [this, f, writes](Parser::Expr *e) {
+        return wrap(arena, hoistIn(e, f->ident, *writes));
+      });
+  }
+
+  // Replaces the largest subexpressions of o that are invariant and can not
+  // fail by temporaries
+  Parser::Opnd *hoistIn(Parser::Opnd *o, Scanner::Token at,
+                        const std::unordered_set<int> &writes) {
+    // Which nodes could move is worked out bottom up in one pass, so that
+    // long operand chains are not rescanned at every level
+    std::unordered_map<const Parser::Opnd *, bool> movable;
+    Parser::Postorder order;
+    order.visit(o, [&](Parser::Opnd *n) {
+      bool m = safeNode(n);
+      if (n->arity == 0)
+        m = m && invariantLeaf(n, writes);
+      else
+        m = m && movable[static_cast<Parser::Expr *>(n)->right] &&
+            (n->arity == 1 || movable[static_cast<Parser::Expr *>(n)->left]);
+      movable[n] = m;
+    });
+    // Operands are visited from a stack of the slots holding them, left to
+    // right, so temporaries are made in source order
+    std::vector<Parser::Opnd **> todo{&o};
+    while (!todo.empty()) {
+      Parser::Opnd **slot = todo.back();
+      todo.pop_back();
+      Parser::Opnd *n = *slot;
+      // Bare operands are as cheap as the temporary would be
+      bool leaf = strip(n)->arity == 0;
+      if (!leaf && movable[n]) {
+        *slot = temporary(n, at);
+        continue;
+      }
+      pushOperands(n, &todo);
+    }
+    return o;
+  }
+
+  static void pushOperands(Parser::Opnd *n, std::vector<Parser::Opnd **> *todo) {
+    if (n->arity == 0)
+      return;
+    auto *e = static_cast<Parser::Expr *>(n);
+    todo->push_back(&e->right);
+    if (n->arity == 2)
+      todo->push_back(&e->left);
+  }
+
+  // Replaces products of the control variable and a loop invariant by
+  // induction variables, which the loop advances by addition
+  void reduce(Parser::For *f, const std::unordered_set<int> &writes) {
+    std::vector<Parser::Induction> inductions;
+    for (Parser::TreeNode *t : f->body->stmts)
+      forEachExpr(t, [&](Parser::Expr *e) {
+        return wrap(arena, reduceIn(e, f, writes, &inductions));
+      });
+    if (inductions.empty())
+      return;
+    f->inductions = arena.makeArray<Parser::Induction>(inductions.size());
+    for (size_t i = 0; i < inductions.size(); i++)
+      f->inductions[i] = inductions[i];
+    f->inductionCount = inductions.size();
+  }
+
+  Parser::Opnd *reduceIn(Parser::Opnd *o, Parser::For *f,
+                         const std::unordered_set<int> &writes,
+                         std::vector<Parser::Induction> *inductions) {
+    std::vector<Parser::Opnd **> todo{&o};
+    while (!todo.empty()) {
+      Parser::Opnd **slot = todo.back();
+      todo.pop_back();
+      auto *b = dynamic_cast<Parser::Binary *>(*slot);
+      if (b && b->op.type == TokenType::ASTERISK) {
+        Parser::Opnd *step = nullptr;
+        if (isControl(b->left, f->slot))
+          step = strip(b->right);
+        else if (isControl(b->right, f->slot))
+          step = strip(b->left);
+        if (step && isStep(step, writes)) {
+          Parser::Ident *v = induction(f, b->op, step, inductions);
+          if (v) {
+            *slot = v;
+            continue;
+          }
+        }
+      }
+      pushOperands(*slot, &todo);
+    }
+    return o;
+  }
+
+  static bool isStep(const Parser::Opnd *o,
+                     const std::unordered_set<int> &writes) {
+    if (auto *i = dynamic_cast<const Parser::Ident *>(o))
+      return !writes.count(i->slot);
+    return dynamic_cast<const Parser::Int *>(o) != nullptr;
+  }
+
+  static bool sameStep(const Parser::Opnd *a, const Parser::Opnd *b) {
+    auto *ia = dynamic_cast<const Parser::Ident *>(a);
+    auto *ib = dynamic_cast<const Parser::Ident *>(b);
+    if (ia || ib)
+      return ia && ib && ia->slot == ib->slot;
+    return static_cast<const Parser::Int *>(a)->number() ==
+           static_cast<const Parser::Int *>(b)->number();
+  }
+
+  // Induction variable equal to control * step, made if there is room
+  Parser::Ident *induction(Parser::For *f, Scanner::Token times,
+                           Parser::Opnd *step,
+                           std::vector<Parser::Induction> *inductions) {
+    for (Parser::Induction &ind : *inductions)
+      if (sameStep(ind.step, step)) {
+        Parser::Ident *i = ident(arena, ind.ident, ind.slot);
+        i->type = ValueType::INT;
+        return i;
+      }
+    if (inductions->size() == Parser::MAX_INDUCTIONS)
+      return nullptr;
+    // The start value is needed twice, so a computed one is stored first
+    if (dynamic_cast<const Parser::Expr *>(strip(f->from)))
+      f->from = wrap(arena, temporary(f->from, f->ident));
+    Parser::Binary *start = arena.make<Parser::Binary>(
+        copyLeaf(strip(f->from)), times, copyLeaf(step));
+    start->type = ValueType::INT;
+    Parser::Ident *i = temporary(start, f->ident);
+    inductions->push_back({i->ident, i->slot, step});
+    return i;
+  }
+
+  Parser::Opnd *copyLeaf(const Parser::Opnd *o) {
+    if (auto *i = dynamic_cast<const Parser::Ident *>(o))
+      return arena.make<Parser::Ident>(*i);
+    return arena.make<Parser::Int>(*static_cast<const Parser::Int *>(o));
+  }
+};
+
+void optimize(Parser::Program *program, Resolver::Symbols *symbols) {
+  FoldWalker fw(program->arena);
+  program->stmts->accept(&fw);
+  LoopWalker lw(program->arena, *symbols);
+  program->stmts->accept(&lw);
+}
+
+} // namespace Optimizer
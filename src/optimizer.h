@@ -0,0 +1,22 @@
+#ifndef OPTIMIZER_H_
+#define OPTIMIZER_H_
+
+#include "parser.h"
+#include "resolver.h"
+
+namespace Optimizer {
+
+// Rewrites a checked program in place: operators whose operands are all
+// literals are folded into literals, asserts that are statically true are
+// removed and for loops with a statically empty range are reduced to the
+// assignment of the control variable. For loops then get their invariant
+// computations hoisted into temporaries, products of the control variable
+// strength-reduced to induction variables and, for small bodies with a known
+// trip count, unrolled. New nodes and their token text come from the program
+// arena and carry the checker's type annotations; temporaries are added to
+// symbols under names no program can use.
+void optimize(Parser::Program *program, Resolver::Symbols *symbols);
+
+} // namespace Optimizer
+
+#endif // OPTIMIZER_H_
@@ -1,255 +1,348 @@
 #include "parser.h"
 #include "compiler.h"
+#include "io.h"
+#include "tokens.h"
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <map>
+#include <optional>
+#include <vector>
 
 namespace Parser {
 
-struct ParserState {
-  Scanner::Token current;
-  Scanner::Token previous;
-  bool hadError = false;
-  bool panicMode = false;
-};
-
-ParserState parser;
-
-Stmts *program;
-
+// Binding strength of operators, loosest first
 enum class Precedence {
-  NONE,
-  ASSIGN, // :=
+  NONE,   // not an operator; marks an open parenthesis on the stack
   AND,    // &
-  EQUAL,  // =
+  EQUAL,  // = <
   TERM,   // + -
   FACTOR, // * /
-  UNARY,  // - !
-  PRIMARY
+  UNARY,  // !
 };
 
-typedef void (*ParseFn)();
-
-struct ParseRule {
-  ParseFn prefix;
-  ParseFn infix;
+// Operator waiting for its right operand while an expression is parsed
+struct Pending {
+  Scanner::Token op;
   Precedence precedence;
 };
-std::map<Scanner::TokenType, ParseRule> rules;
 
-static void printCurrent(std::string msg) {
-  std::cout << msg << Scanner::getName(parser.current) << std::endl;
+// State of one parse. Every parse has its own, so separate programs can be
+// parsed concurrently.
+struct ParserState {
+  Scanner::Scanner scanner;
+  // Tokens of a source tokenized up front; scanned one by one if empty
+  std::optional<Tokens::Reader> tokens;
+  Scanner::Token current;
+  Scanner::Token previous;
+  bool hadError = false;
+  bool panicMode = false;
+  // Arena of the program being parsed, all nodes are allocated from it
+  Memory::Arena *arena;
+  // Stacks of the expression being parsed, kept to reuse their storage
+  std::vector<Opnd *> operands;
+  std::vector<Pending> operators;
+};
+
+template <typename T, typename... Args>
+static T *make(ParserState *parser, Args &&...args) {
+  return parser->arena->make<T>(std::forward<Args>(args)...);
 }
 
-static bool isCurrent(Scanner::TokenType t) { return parser.current.type == t; }
+static void printCurrent(ParserState *parser, std::string msg) {
+  std::cout << msg << Scanner::getName(parser->current) << std::endl;
+}
 
-static void errorAt(Scanner::Token t, std::string msg) {
-  if (parser.panicMode)
+static bool isCurrent(ParserState *parser, Scanner::TokenType t) {
+  return parser->current.type == t;
+}
+
+static void errorAt(ParserState *parser, Scanner::Token t, std::string msg) {
+  if (parser->panicMode)
     return;
-  parser.panicMode = true;
-  fprintf(stderr, "[line %d] Error", t.line);
+  parser->panicMode = true;
+  IO::errorf("[line %d] Error", t.line);
 
   if (t.type == Scanner::TokenType::SCAN_EOF) {
-    fprintf(stderr, " at end");
+    IO::errorf(" at end");
   } else if (t.type == Scanner::TokenType::ERROR) {
-    fprintf(stderr, " %s", t.message);
+    IO::errorf(" %s", t.message);
   } else {
-    fprintf(stderr, " at '%.*s'", t.length, t.start);
+    IO::errorf(" at '%.*s'", t.length, t.start);
   }
 
-  fprintf(stderr, ": %s\n", msg.c_str());
-  parser.hadError = true;
+  IO::errorf(": %s\n", msg.c_str());
+  parser->hadError = true;
 }
 
-static void advance() {
-  parser.previous = parser.current;
+static void advance(ParserState *parser) {
+  parser->previous = parser->current;
   for (;;) {
-    parser.current = Scanner::scanToken();
-    if (!isCurrent(Scanner::TokenType::ERROR))
+    parser->current = parser->tokens ? parser->tokens->next()
+                                      : Scanner::scanToken(&parser->scanner);
+    if (!isCurrent(parser, Scanner::TokenType::ERROR))
       break;
-    errorAt(parser.current, "Scanner error");
+    errorAt(parser, parser->current, "Scanner error");
   }
 }
 
-static void consume(Scanner::TokenType type, std::string msg) {
-  if (parser.current.type == type) {
-    advance();
+static void consume(ParserState *parser, Scanner::TokenType type,
+                    std::string msg) {
+  if (parser->current.type == type) {
+    advance(parser);
     return;
   }
-  errorAt(parser.current, msg);
+  errorAt(parser, parser->current, msg);
 }
 
-static void exitPanic() {
-  while (!isCurrent(Scanner::TokenType::SEMICOLON)) {
-    if (isCurrent(Scanner::TokenType::SCAN_EOF))
+static void exitPanic(ParserState *parser) {
+  while (!isCurrent(parser, Scanner::TokenType::SEMICOLON)) {
+    if (isCurrent(parser, Scanner::TokenType::SCAN_EOF))
       break;
-    std::cout << "Skipping token:" << Scanner::getName(parser.current)
+    IO::out() << "Skipping token:" << Scanner::getName(parser->current)
               << std::endl;
-    advance();
+    advance(parser);
   }
-  parser.panicMode = false;
+  parser->panicMode = false;
 }
 
-static bool isBinaryOp() {
-  return isCurrent(Scanner::TokenType::PLUS) ||
-         isCurrent(Scanner::TokenType::MINUS) ||
-         isCurrent(Scanner::TokenType::ASTERISK) ||
-         isCurrent(Scanner::TokenType::SLASH) ||
-         isCurrent(Scanner::TokenType::LESS) ||
-         isCurrent(Scanner::TokenType::EQUAL) ||
-         isCurrent(Scanner::TokenType::AND);
+static Precedence precedence(Scanner::TokenType t) {
+  switch (t) {
+  case Scanner::TokenType::AND:
+    return Precedence::AND;
+  case Scanner::TokenType::EQUAL:
+  case Scanner::TokenType::LESS:
+    return Precedence::EQUAL;
+  case Scanner::TokenType::PLUS:
+  case Scanner::TokenType::MINUS:
+    return Precedence::TERM;
+  case Scanner::TokenType::ASTERISK:
+  case Scanner::TokenType::SLASH:
+    return Precedence::FACTOR;
+  default:
+    return Precedence::NONE;
+  }
 }
 
-static bool isUnaryOp() { return isCurrent(Scanner::TokenType::NOT); }
-
-static bool isType() {
-  return isCurrent(Scanner::TokenType::INT) ||
-         isCurrent(Scanner::TokenType::STRING) ||
-         isCurrent(Scanner::TokenType::BOOL);
+static bool isUnaryOp(ParserState *parser) {
+  return isCurrent(parser, Scanner::TokenType::NOT);
 }
-static Expr *expression();
 
-static Opnd *operand() {
-  if (isCurrent(Scanner::TokenType::INTEGER_LIT)) {
-    advance();
-    return new Int(parser.previous);
+static bool isType(ParserState *parser) {
+  return isCurrent(parser, Scanner::TokenType::INT) ||
+         isCurrent(parser, Scanner::TokenType::STRING) ||
+         isCurrent(parser, Scanner::TokenType::BOOL);
+}
+static Opnd *operand(ParserState *parser) {
+  if (isCurrent(parser, Scanner::TokenType::INTEGER_LIT)) {
+    advance(parser);
+    return make<Int>(parser, parser->previous);
   }
-  if (isCurrent(Scanner::TokenType::STRING_LIT)) {
-    advance();
-    return new String(parser.previous);
+  if (isCurrent(parser, Scanner::TokenType::STRING_LIT)) {
+    advance(parser);
+    return make<String>(parser, parser->previous,
+                        unEscape(parser->previous, *parser->arena));
   }
-  if (isCurrent(Scanner::TokenType::BOOLEAN_LIT)) {
-    advance();
-    return new Bool(parser.previous);
+  if (isCurrent(parser, Scanner::TokenType::BOOLEAN_LIT)) {
+    advance(parser);
+    return make<Bool>(parser, parser->previous);
   }
-  if (isCurrent(Scanner::TokenType::IDENTIFIER)) {
-    advance();
-    return new Ident(parser.previous);
+  if (isCurrent(parser, Scanner::TokenType::IDENTIFIER)) {
+    advance(parser);
+    return make<Ident>(parser, parser->previous);
+  }
+  errorAt(parser, parser->current, "Expected literal, identifier, or '('");
+  return make<Opnd>(parser);
+}
+
+// Applies the operator on top of the stack to its operands
+static void reduce(ParserState *parser) {
+  Pending p = parser->operators.back();
+  parser->operators.pop_back();
+  Opnd *right = parser->operands.back();
+  parser->operands.pop_back();
+  if (p.precedence == Precedence::UNARY) {
+    parser->operands.push_back(make<Unary>(parser, p.op, right));
+  } else {
+    Opnd *left = parser->operands.back();
+    parser->operands.back() = make<Binary>(parser, left, p.op, right);
   }
-  consume(Scanner::TokenType::LEFT_PAREN,
-          "Expected literal, identifier, or '('");
-  Expr *e = expression();
-  consume(Scanner::TokenType::RIGHT_PAREN, "Expected ')'");
-  return e;
 }
 
-static Expr *expression() {
-  if (isUnaryOp()) {
-    advance();
-    return new Unary(parser.previous, operand());
+// Applies the operators above base that bind at least as tightly as p. An
+// open parenthesis binds less tightly than any operator, so this stops there.
+static void reduceTo(ParserState *parser, size_t base, Precedence p) {
+  while (parser->operators.size() > base &&
+         parser->operators.back().precedence >= p)
+    reduce(parser);
+}
+
+// Ends the innermost parenthesized operand
+static void closeParen(ParserState *parser, size_t base) {
+  reduceTo(parser, base, Precedence::AND);
+  parser->operators.pop_back();
+  Opnd *&inner = parser->operands.back();
+  if (inner->arity == 0)
+    inner = make<Single>(parser, inner);
+}
+
+// Precedence climbing with explicit operand and operator stacks instead of
+// recursion, so that neither long operand chains nor deep parentheses can
+// exhaust the native stack. Binary operators are left associative; '!'
+// applies to the operand that follows it.
+static Expr *expression(ParserState *parser) {
+  size_t base = parser->operators.size();
+  size_t open = 0;
+  for (;;) {
+    for (;; advance(parser)) {
+      if (isUnaryOp(parser)) {
+        parser->operators.push_back({parser->current, Precedence::UNARY});
+      } else if (isCurrent(parser, Scanner::TokenType::LEFT_PAREN)) {
+        parser->operators.push_back({parser->current, Precedence::NONE});
+        open++;
+      } else {
+        break;
+      }
+    }
+    parser->operands.push_back(operand(parser));
+    for (; open > 0 && isCurrent(parser, Scanner::TokenType::RIGHT_PAREN);
+         open--) {
+      closeParen(parser, base);
+      advance(parser);
+    }
+    Precedence p = precedence(parser->current.type);
+    if (p == Precedence::NONE)
+      break;
+    reduceTo(parser, base, p);
+    parser->operators.push_back({parser->current, p});
+    advance(parser);
   }
-  Opnd *left = operand();
-  if (isBinaryOp()) {
-    advance();
-    return new Binary(left, parser.previous, expression());
-  } else
-    return new Single(left);
+  for (; open > 0; open--) {
+    errorAt(parser, parser->current, "Expected ')'");
+    closeParen(parser, base);
+  }
+  reduceTo(parser, base, Precedence::AND);
+  Opnd *result = parser->operands.back();
+  parser->operands.pop_back();
+  if (result->arity == 0)
+    return make<Single>(parser, result);
+  return static_cast<Expr *>(result);
 }
 
-static Var *var() {
-  advance();
-  Var *v = new Var();
-  consume(Scanner::TokenType::IDENTIFIER, "Expected an identifier after 'var'");
-  v->ident = parser.previous;
-  consume(Scanner::TokenType::COLON, "Expected an ':' after identifier");
-  if (isType()) {
-    v->type = parser.current;
-    advance();
+static Var *var(ParserState *parser) {
+  advance(parser);
+  Var *v = make<Var>(parser);
+  consume(parser, Scanner::TokenType::IDENTIFIER,
+          "Expected an identifier after 'var'");
+  v->ident = parser->previous;
+  consume(parser, Scanner::TokenType::COLON,
+          "Expected an ':' after identifier");
+  if (isType(parser)) {
+    v->type = parser->current;
+    advance(parser);
   } else {
-    errorAt(parser.current, "Expected type after ':'");
+    errorAt(parser, parser->current, "Expected type after ':'");
   }
-  if (isCurrent(Scanner::TokenType::ASSIGN)) {
-    advance();
-    v->expr = expression();
+  if (isCurrent(parser, Scanner::TokenType::ASSIGN)) {
+    advance(parser);
+    v->expr = expression(parser);
   }
   return v;
 }
 
-static Assign *assign() {
-  advance();
-  Scanner::Token id = parser.previous;
-  consume(Scanner::TokenType::ASSIGN, "Expected ':=' after identifier");
-  Expr *e = expression();
-  return new Assign(id, e);
+static Assign *assign(ParserState *parser) {
+  advance(parser);
+  Scanner::Token id = parser->previous;
+  consume(parser, Scanner::TokenType::ASSIGN, "Expected ':=' after identifier");
+  Expr *e = expression(parser);
+  return make<Assign>(parser, id, e);
 }
 
-static Print *print() {
-  advance();
-  Print *p = new Print();
-  p->expr = expression();
+static Print *print(ParserState *parser) {
+  advance(parser);
+  Print *p = make<Print>(parser);
+  p->keyword = parser->previous;
+  p->expr = expression(parser);
   return p;
 }
 
-static Read *read() {
-  advance();
-  consume(Scanner::TokenType::IDENTIFIER, "Expected identifier after read");
-  return new Read(parser.previous);
+static Read *read(ParserState *parser) {
+  advance(parser);
+  consume(parser, Scanner::TokenType::IDENTIFIER,
+          "Expected identifier after read");
+  return make<Read>(parser, parser->previous);
 }
 
-static Assert *assert() {
-  advance();
-  consume(Scanner::TokenType::LEFT_PAREN, "Expected '(' after assert");
-  Expr *e = expression();
-  consume(Scanner::TokenType::RIGHT_PAREN,
+static Assert *assert(ParserState *parser) {
+  advance(parser);
+  Scanner::Token keyword = parser->previous;
+  consume(parser, Scanner::TokenType::LEFT_PAREN, "Expected '(' after assert");
+  Expr *e = expression(parser);
+  consume(parser, Scanner::TokenType::RIGHT_PAREN,
           "Expected ')' after assert expression");
-  return new Assert(e);
+  return make<Assert>(parser, keyword, e);
 }
 
-static Stmts *statements();
-static For *forLoop() {
-  advance();
-  consume(Scanner::TokenType::IDENTIFIER, "Expected identifier after for");
-  Scanner::Token id = parser.previous;
-  consume(Scanner::TokenType::IN, "Expected 'in' after identifier");
-  Expr *from = expression();
-  consume(Scanner::TokenType::RANGE, "Expected '..' after expression");
-  Expr *to = expression();
-  consume(Scanner::TokenType::DO, "Expected 'do' after expression");
-  Stmts *body = statements();
-  consume(Scanner::TokenType::END, "Expected 'end' after loop body");
-  consume(Scanner::TokenType::FOR, "Expected 'for' after end");
-  return new For(id, from, to, body);
+static Stmts *statements(ParserState *parser);
+static For *forLoop(ParserState *parser) {
+  advance(parser);
+  consume(parser, Scanner::TokenType::IDENTIFIER,
+          "Expected identifier after for");
+  Scanner::Token id = parser->previous;
+  consume(parser, Scanner::TokenType::IN, "Expected 'in' after identifier");
+  Expr *from = expression(parser);
+  consume(parser, Scanner::TokenType::RANGE, "Expected '..' after expression");
+  Expr *to = expression(parser);
+  consume(parser, Scanner::TokenType::DO, "Expected 'do' after expression");
+  Stmts *body = statements(parser);
+  consume(parser, Scanner::TokenType::END, "Expected 'end' after loop body");
+  consume(parser, Scanner::TokenType::FOR, "Expected 'for' after end");
+  return make<For>(parser, id, from, to, body);
 }
 
-static Stmt *statement() {
-  Stmt *s = new Stmt();
-  if (isCurrent(Scanner::TokenType::VAR)) {
-    s = var();
-  } else if (isCurrent(Scanner::TokenType::IDENTIFIER)) {
-    s = assign();
-  } else if (isCurrent(Scanner::TokenType::FOR)) {
-    s = forLoop();
-  } else if (isCurrent(Scanner::TokenType::READ)) {
-    s = read();
-  } else if (isCurrent(Scanner::TokenType::PRINT)) {
-    s = print();
-  } else if (isCurrent(Scanner::TokenType::ASSERT)) {
-    s = assert();
-  } else
-    exitPanic();
-  consume(Scanner::TokenType::SEMICOLON, "Expected ';' at end of statement");
+static Stmt *statement(ParserState *parser) {
+  Stmt *s;
+  if (isCurrent(parser, Scanner::TokenType::VAR)) {
+    s = var(parser);
+  } else if (isCurrent(parser, Scanner::TokenType::IDENTIFIER)) {
+    s = assign(parser);
+  } else if (isCurrent(parser, Scanner::TokenType::FOR)) {
+    s = forLoop(parser);
+  } else if (isCurrent(parser, Scanner::TokenType::READ)) {
+    s = read(parser);
+  } else if (isCurrent(parser, Scanner::TokenType::PRINT)) {
+    s = print(parser);
+  } else if (isCurrent(parser, Scanner::TokenType::ASSERT)) {
+    s = assert(parser);
+  } else {
+    s = make<Stmt>(parser);
+    exitPanic(parser);
+  }
+  consume(parser, Scanner::TokenType::SEMICOLON,
+          "Expected ';' at end of statement");
   return s;
 }
-static Stmts *statements() {
-  Stmts *s = new Stmts();
+// Skips comments and reports scanner errors up to the next statement.
+// Returns false at the end of the source or of the enclosing block.
+static bool atStatement(ParserState *parser) {
   for (;;) {
-    if (isCurrent(Scanner::TokenType::COMMENT)) {
-      advance();
+    if (isCurrent(parser, Scanner::TokenType::COMMENT)) {
+      advance(parser);
       continue;
     }
-    if (isCurrent(Scanner::TokenType::ERROR)) {
-      errorAt(parser.current, parser.current.message);
-      exitPanic();
+    if (isCurrent(parser, Scanner::TokenType::ERROR)) {
+      errorAt(parser, parser->current, parser->current.message);
+      exitPanic(parser);
       continue;
     }
-    if (isCurrent(Scanner::TokenType::SCAN_EOF) ||
-        isCurrent(Scanner::TokenType::END)) {
-      return s;
-    }
-    // std::cout << "Parsing statement at: " << Scanner::getName(parser.current)
-    // << std::endl;
-    s->append(statement());
+    return !isCurrent(parser, Scanner::TokenType::SCAN_EOF) &&
+           !isCurrent(parser, Scanner::TokenType::END);
   }
+}
+static Stmts *statements(ParserState *parser) {
+  Stmts *s = make<Stmts>(parser);
+  while (atStatement(parser))
+    s->append(*parser->arena, statement(parser));
   return s;
 }
 
@@ -262,27 +355,9 @@ public:
   void visitString(const String *s) override { printToken(s->value); }
   void visitIdent(const Ident *i) override { printToken(i->ident); }
   void visitExpr(const Expr *e) override { std::cout << "DUMMYEXPR"; }
-  void visitBinary(const Binary *b) override {
-    std::cout << "(";
-    b->left->accept(this);
-    std::cout << " ";
-    printToken(b->op);
-    std::cout << " ";
-    b->right->accept(this);
-    std::cout << ")";
-  }
-  void visitUnary(const Unary *u) override {
-    std::cout << "(";
-    printToken(u->op);
-    std::cout << " ";
-    u->right->accept(this);
-    std::cout << ")";
-  }
-  void visitSingle(const Single *s) override {
-    std::cout << "(";
-    s->right->accept(this);
-    std::cout << ")";
-  }
+  void visitBinary(const Binary *b) override { expr(b); }
+  void visitUnary(const Unary *u) override { expr(u); }
+  void visitSingle(const Single *s) override { expr(s); }
   void visitStmt(const Stmt *s) override {
     std::cout << "(stmt ";
     std::cout << s->info;
@@ -326,6 +401,13 @@ public:
     f->to->accept(this);
     std::cout << " body:\n";
     f->body->accept(this);
+    for (uint32_t i = 0; i < f->inductionCount; i++) {
+      std::cout << "(step ident:";
+      printToken(f->inductions[i].ident);
+      std::cout << " by:";
+      f->inductions[i].step->accept(this);
+      std::cout << ")\n";
+    }
     std::cout << "end for";
     std::cout << ")";
   }
@@ -347,33 +429,136 @@ public:
     a->expr->accept(this);
     std::cout << ")";
   }
+
+private:
+  // Prints an expression from a stack of what is left to print, a node or
+  // a piece of text, rather than by recursion
+  void expr(const Expr *root) {
+    std::vector<std::pair<const Opnd *, std::string_view>> todo;
+    todo.push_back({root, {}});
+    while (!todo.empty()) {
+      auto [n, text] = todo.back();
+      todo.pop_back();
+      if (!n) {
+        std::cout << text;
+        continue;
+      }
+      if (n->arity == 0) {
+        const_cast<Opnd *>(n)->accept(this);
+        continue;
+      }
+      auto *e = static_cast<const Expr *>(n);
+      std::string_view op(e->op.start, e->op.length);
+      todo.push_back({nullptr, ")"});
+      todo.push_back({e->right, {}});
+      if (n->arity == 2) {
+        todo.push_back({nullptr, " "});
+        todo.push_back({nullptr, op});
+        todo.push_back({nullptr, " "});
+        todo.push_back({e->left, {}});
+      } else if (dynamic_cast<const Unary *>(e)) {
+        todo.push_back({nullptr, " "});
+        todo.push_back({nullptr, op});
+      }
+      todo.push_back({nullptr, "("});
+    }
+  }
 };
 
 void pprint(Stmts *ss) {
-  PrintWalker *pw = new PrintWalker();
-  ss->accept(pw);
+  PrintWalker pw;
+  ss->accept(&pw);
 }
 
-bool parse(const std::string source) {
-  Scanner::init(source);
-  parser.hadError = false;
-  parser.panicMode = false;
-  advance();
-  program = statements();
-  consume(Scanner::TokenType::SCAN_EOF, "");
-  pprint(program);
+bool parseProgram(std::string_view source, Program *program) {
+  program->source = source.data();
+  program->length = source.size();
+  ParserState parser;
+  // Only worth the extra pass when the scanning is spread over threads
+  Tokens::Buffer tokens;
+  unsigned threads = Tokens::threadsFor(source.size());
+  if (threads > 1) {
+    Tokens::tokenize(source, &tokens, threads);
+    parser.tokens.emplace(tokens);
+  } else {
+    Scanner::init(&parser.scanner, source.data(),
+                  source.data() + source.size());
+  }
+  parser.arena = &program->arena;
+  advance(&parser);
+  program->stmts = statements(&parser);
+  consume(&parser, Scanner::TokenType::SCAN_EOF, "");
   return !parser.hadError;
 }
 
-void parseAndWalk(const std::string source, TreeWalker *tw) {
-  Scanner::init(source);
-  parser.hadError = false;
-  parser.panicMode = false;
-  advance();
-  program = statements();
-  consume(Scanner::TokenType::SCAN_EOF, "");
-  if (!parser.hadError)
-    program->accept(tw);
+std::string_view unEscape(Scanner::Token literal, Memory::Arena &arena) {
+  // strip ""
+  const char *s = literal.start + 1;
+  size_t length = literal.length - 2;
+  if (!memchr(s, '\\', length))
+    return std::string_view(s, length);
+  char *o = arena.makeArray<char>(length);
+  size_t n = 0;
+  for (size_t i = 0; i < length; i++) {
+    char c = s[i];
+    if (c == '\\' && i + 1 < length) {
+      switch (s[++i]) {
+      case 'n':
+        c = '\n';
+        break;
+      case 't':
+        c = '\t';
+        break;
+      default:
+        c = s[i];
+      }
+    }
+    o[n++] = c;
+  }
+  return std::string_view(o, n);
+}
+
+bool parse(std::string_view source) {
+  Program program;
+  bool ok = parseProgram(source, &program);
+  if (ok)
+    pprint(program.stmts);
+  return ok;
 }
 
+void parseAndWalk(std::string_view source, TreeWalker *tw) {
+  Stream stream(source);
+  Program unit;
+  while (stream.next(&unit) && !stream.hadError())
+    unit.stmts->accept(tw);
+}
+
+// Always scans on demand: tokenizing up front would delay the first
+// statement by the whole source
+Stream::Stream(std::string_view s) : source(s), parser(new ParserState()) {
+  Scanner::init(&parser->scanner, source.data(), source.data() + source.size());
+  advance(parser.get());
+}
+
+Stream::~Stream() = default;
+
+bool Stream::next(Program *unit) {
+  ParserState *p = parser.get();
+  unit->arena.reset();
+  unit->stmts = nullptr;
+  unit->source = source.data();
+  unit->length = source.size();
+  p->arena = &unit->arena;
+  if (!atStatement(p)) {
+    // A stray 'end' at the top level, as parseProgram reports it
+    consume(p, Scanner::TokenType::SCAN_EOF, "");
+    return false;
+  }
+  unit->stmts = make<Stmts>(p);
+  unit->stmts->append(unit->arena, statement(p));
+  return true;
+}
+
+bool Stream::hadError() const { return parser->hadError; }
+
 } // namespace Parser
@@ -1,9 +1,14 @@
 #ifndef PARSER_H_
 #define PARSER_H_
 
+#include "memory.h"
 #include "scanner.h"
-#include <list>
+#include "value.h"
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace Parser {
 
@@ -52,12 +57,27 @@ public:
 
 class Opnd : public TreeNode {
 public:
+  // Static type of the operand, set by Checker::check
+  Runtime::ValueType type = Runtime::ValueType::INT;
+  // Number of operands: 2 for Binary, 1 for Unary and Single, 0 for leaves
+  uint8_t arity = 0;
   void accept(TreeWalker *t) override { t->visitOpnd(this); };
 };
 class Int : public Opnd {
 public:
   Scanner::Token value;
   Int(Scanner::Token v) { this->value = v; }
+  // Value of the literal. The checker has ruled out source literals that do
+  // not fit; literals made by the optimizer may be negative.
+  int32_t number() const {
+    const char *c = value.start;
+    const char *end = value.start + value.length;
+    bool negative = c < end && *c == '-';
+    uint32_t n = 0;
+    for (c += negative; c < end; c++)
+      n = n * 10 + (*c - '0');
+    return (int32_t)(negative ? 0u - n : n);
+  }
   void accept(TreeWalker *t) override { t->visitInt(this); };
 };
 class Bool : public Opnd {
@@ -69,12 +89,19 @@ public:
 class String : public Opnd {
 public:
   Scanner::Token value;
-  String(Scanner::Token v) { this->value = v; }
+  // The literal without its quotes and with its escapes decoded. It points
+  // into the source, or into the program arena if there were escapes.
+  std::string_view text;
+  String(Scanner::Token v, std::string_view t) {
+    this->value = v;
+    this->text = t;
+  }
   void accept(TreeWalker *t) override { t->visitString(this); };
 };
 class Ident : public Opnd {
 public:
   Scanner::Token ident;
+  int slot = -1; // assigned by Resolver::resolve
   Ident(Scanner::Token v) { this->ident = v; }
   void accept(TreeWalker *t) override { t->visitIdent(this); };
 };
@@ -91,6 +118,7 @@ public:
     this->left = left;
     this->op = op;
     this->right = right;
+    arity = 2;
   }
   void accept(TreeWalker *t) override { t->visitBinary(this); };
 };
@@ -99,37 +127,116 @@ public:
   Unary(Scanner::Token op, Parser::Opnd *right) {
     this->op = op;
     this->right = right;
+    arity = 1;
   }
   void accept(TreeWalker *t) override { t->visitUnary(this); };
 };
 class Single : public Expr {
 public:
-  Single(Parser::Opnd *right) { this->right = right; }
+  Single(Parser::Opnd *right) {
+    this->right = right;
+    arity = 1;
+  }
   void accept(TreeWalker *t) override { t->visitSingle(this); };
 };
+
+// Visits the nodes of an expression in post-order, the operands of a node
+// before the node itself. Uses an explicit stack, so operand chains of any
+// length fit on the native stack; the stack is kept between calls so that
+// visiting does not allocate once it has grown.
+class Postorder {
+public:
+  template <typename F> void visit(Opnd *root, F f) {
+    // Frames below base belong to a visit in progress around this one
+    size_t base = stack.size();
+    stack.push_back({root, false});
+    while (stack.size() > base) {
+      Frame &top = stack.back();
+      Opnd *n = top.node;
+      if (top.expanded || n->arity == 0) {
+        stack.pop_back();
+        f(n);
+        continue;
+      }
+      top.expanded = true;
+      Expr *e = static_cast<Expr *>(n);
+      stack.push_back({e->right, false});
+      if (n->arity == 2)
+        stack.push_back({e->left, false});
+    }
+  }
+
+private:
+  struct Frame {
+    Opnd *node;
+    bool expanded;
+  };
+  std::vector<Frame> stack;
+};
+
+// Walker for which the operands of a Binary, Unary or Single have been
+// visited by the time the node itself is: expressions are walked with
+// walkExpr, in post-order and without recursion.
+class ExprWalker : public TreeWalker {
+protected:
+  void walkExpr(Opnd *e) {
+    order.visit(e, [this](Opnd *n) { n->accept(this); });
+  }
+
+private:
+  Postorder order;
+};
+
 class Stmt : public TreeNode {
 public:
-  std::string info;
+  const char *info;
   Stmt() { info = "dummy statement"; }
   void accept(TreeWalker *t) override { t->visitStmt(this); };
 };
+// Growable array of nodes whose storage comes from the program arena
+class NodeList {
+public:
+  void push_back(Memory::Arena &arena, TreeNode *n) {
+    if (count == capacity) {
+      capacity = capacity ? 2 * capacity : 4;
+      TreeNode **grown = arena.makeArray<TreeNode *>(capacity);
+      for (uint32_t i = 0; i < count; i++)
+        grown[i] = items[i];
+      items = grown;
+    }
+    items[count++] = n;
+  }
+  TreeNode *const *begin() const { return items; }
+  TreeNode *const *end() const { return items + count; }
+  uint32_t size() const { return count; }
+
+private:
+  TreeNode **items = nullptr;
+  uint32_t count = 0;
+  uint32_t capacity = 0;
+};
 class Stmts : public TreeNode {
 public:
-  std::list<TreeNode *> stmts;
-  void append(Stmt *s) { stmts.push_back(s); }
+  NodeList stmts;
+  void append(Memory::Arena &arena, Stmt *s) { stmts.push_back(arena, s); }
   void accept(TreeWalker *t) override { t->visitStmts(this); };
 };
 class Var : public Stmt {
 public:
   Scanner::Token ident;
+  int slot = -1;
   Scanner::Token type;
   Expr *expr;
-  Var() { info = "Var"; }
+  Var() {
+    expr = nullptr;
+    info = "Var";
+  }
   void accept(TreeWalker *t) override { t->visitVar(this); };
 };
 class Assign : public Stmt {
 public:
   Scanner::Token ident;
+  int slot = -1;
   Expr *expr;
   Assign(Scanner::Token id, Parser::Expr *e) {
     this->ident = id;
@@ -138,12 +245,24 @@ public:
   }
   void accept(TreeWalker *t) override { t->visitAssign(this); };
 };
+// Variable the loop optimizer keeps equal to a multiple of the loop control
+// variable: it is set before the loop and advanced by step after every
+// iteration
+struct Induction {
+  Scanner::Token ident;
+  int slot;
+  Opnd *step; // literal or variable not written in the loop
+};
+const uint32_t MAX_INDUCTIONS = 4;
 class For : public Stmt {
 public:
   Scanner::Token ident;
+  int slot = -1;
   Expr *from;
   Expr *to;
   Stmts *body;
+  Induction *inductions = nullptr;
+  uint32_t inductionCount = 0;
   For(Scanner::Token id, Parser::Expr *f, Parser::Expr *t, Parser::Stmts *b) {
     this->ident = id;
     this->from = f;
@@ -156,6 +275,7 @@ public:
 class Read : public Stmt {
 public:
   Scanner::Token ident;
+  int slot = -1;
   Read(Scanner::Token i) {
     this->ident = i;
     info = "Read";
@@ -164,24 +284,77 @@ public:
 };
 class Print : public Stmt {
 public:
+  Scanner::Token keyword;
   Expr *expr;
   Print() { info = "Print"; }
   void accept(TreeWalker *t) override { t->visitPrint(this); };
 };
 class Assert : public Stmt {
 public:
+  Scanner::Token keyword;
   Expr *expr;
-  Assert(Parser::Expr *e) {
+  Assert(Scanner::Token k, Parser::Expr *e) {
+    this->keyword = k;
     this->expr = e;
     info = "Assert";
   }
   void accept(TreeWalker *t) override { t->visitAssert(this); };
 };
 
-bool parse(const std::string source);
-void parseAndWalk(const std::string source, TreeWalker *tw);
+// Result of a parse. Owns the syntax tree, which is freed all at once. Tokens
+// point into the source text, which is not copied: it has to outlive the
+// program.
+class Program {
+public:
+  Stmts *stmts = nullptr;
+  const char *source = nullptr;
+  size_t length = 0;
+  Memory::Arena arena;
 
-Stmts *getProgram();
+  void release() {
+    stmts = nullptr;
+    source = nullptr;
+    length = 0;
+    arena.release();
+  }
+};
+
+// Parses source into program, returns false on syntax errors. The source
+// does not need a terminating NUL, so it can be a mapped file. A large
+// source is tokenized as a whole first, on several threads.
+bool parseProgram(std::string_view source, Program *program);
+bool parse(std::string_view source);
+// Prints the tree in the format of -p
+void pprint(Stmts *ss);
+// Text of a string literal token without its quotes: \n and \t become
+// control characters, any other escaped character stands for itself. Only
+// literals with escapes are copied, into arena.
+std::string_view unEscape(Scanner::Token literal, Memory::Arena &arena);
+// Walks each top-level statement of source as soon as it has been parsed,
+// up to the first syntax error
+void parseAndWalk(std::string_view source, TreeWalker *tw);
+
+struct ParserState;
+
+// Parses a source one top-level statement at a time, so that it can be run
+// while the rest is still unparsed. A for loop is a single statement.
+class Stream {
+public:
+  explicit Stream(std::string_view source);
+  ~Stream();
+
+  // Parses the next statement into unit, as its only statement, and returns
+  // false at the end of the source. The arena of unit is reset first, so
+  // the nodes of the previous statement are gone and memory stays bounded
+  // by the largest statement.
+  bool next(Program *unit);
+  // Whether a syntax error has been reported so far
+  bool hadError() const;
+
+private:
+  std::string_view source;
+  std::unique_ptr<ParserState> parser;
+};
 
 } // namespace Parser
 
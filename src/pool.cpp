@@ -0,0 +1,82 @@
+#include "pool.h"
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Pool {
+
+// Budget of the current thread; 0 outside of any pool
+static thread_local unsigned threadBudget = 0;
+
+unsigned budget() {
+  if (threadBudget)
+    return threadBudget;
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Task indices of one thread. The owner takes from the front, thieves from
+// the back.
+struct Queue {
+  std::mutex lock;
+  std::deque<size_t> tasks;
+
+  bool takeFront(size_t *task) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (tasks.empty())
+      return false;
+    *task = tasks.front();
+    tasks.pop_front();
+    return true;
+  }
+  bool takeBack(size_t *task) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (tasks.empty())
+      return false;
+    *task = tasks.back();
+    tasks.pop_back();
+    return true;
+  }
+};
+
+static void work(std::vector<std::unique_ptr<Queue>> &queues, unsigned self,
+                 unsigned share, const std::function<void(size_t)> &task) {
+  threadBudget = share;
+  size_t i;
+  for (;;) {
+    while (queues[self]->takeFront(&i))
+      task(i);
+    // No task creates new ones, so once every queue is seen empty there is
+    // nothing left to do
+    bool stole = false;
+    for (unsigned k = 1; k < queues.size() && !stole; k++)
+      stole = queues[(self + k) % queues.size()]->takeBack(&i);
+    if (!stole)
+      return;
+    task(i);
+  }
+}
+
+void parallelFor(size_t n, unsigned threads,
+                 const std::function<void(size_t)> &task) {
+  threads = (unsigned)std::max<size_t>(1, std::min<size_t>(threads, n));
+  std::vector<std::unique_ptr<Queue>> queues;
+  for (unsigned t = 0; t < threads; t++) {
+    queues.emplace_back(new Queue);
+    for (size_t i = n * t / threads; i < n * (t + 1) / threads; i++)
+      queues[t]->tasks.push_back(i);
+  }
+  unsigned outer = threadBudget;
+  unsigned share = std::max(1u, budget() / threads);
+  std::vector<std::thread> workers;
+  for (unsigned t = 1; t < threads; t++)
+    workers.emplace_back(work, std::ref(queues), t, share, std::cref(task));
+  work(queues, 0, share, task);
+  threadBudget = outer;
+  for (std::thread &w : workers)
+    w.join();
+}
+
+} // namespace Pool
@@ -0,0 +1,27 @@
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <cstddef>
+#include <functional>
+
+// Work-stealing thread pool for a fixed set of independent tasks
+namespace Pool {
+
+// Runs task(i) for every i in [0, n) on up to threads threads, the calling
+// thread being one of them. Each thread starts with a contiguous block of
+// indices which it works through from the front; a thread that runs out
+// steals from the back of another thread's block, so uneven tasks still
+// keep every thread busy. Returns once all tasks have finished.
+void parallelFor(size_t n, unsigned threads,
+                 const std::function<void(size_t)> &task);
+
+// Threads the calling code may use for parallel work of its own: all
+// hardware threads outside of parallelFor, and inside a task the share of
+// them left to each of the pool's threads, at least 1. Keeps nested
+// parallel work, such as tokenizing in a batch worker, from oversubscribing
+// the machine.
+unsigned budget();
+
+} // namespace Pool
+
+#endif // POOL_H_
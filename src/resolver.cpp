@@ -0,0 +1,114 @@
+#include "resolver.h"
+#include "io.h"
+#include <cstdio>
+#include <set>
+
+namespace Resolver {
+
+Runtime::ValueType declaredType(Scanner::TokenType t) {
+  if (t == Scanner::TokenType::BOOL)
+    return Runtime::ValueType::BOOL;
+  if (t == Scanner::TokenType::STRING)
+    return Runtime::ValueType::STRING;
+  return Runtime::ValueType::INT;
+}
+
+class ResolveWalker : public Parser::ExprWalker {
+public:
+  Symbols *symbols;
+  bool hadError = false;
+
+  ResolveWalker(Symbols *s) { symbols = s; }
+
+  void visitOpnd(const Parser::Opnd *i) override {}
+  void visitInt(const Parser::Int *i) override {}
+  void visitBool(const Parser::Bool *b) override {}
+  void visitString(const Parser::String *s) override {}
+  void visitIdent(const Parser::Ident *i) override {
+    const_cast<Parser::Ident *>(i)->slot = lookup(i->ident);
+  }
+  void visitExpr(const Parser::Expr *e) override {}
+  void visitBinary(const Parser::Binary *b) override {}
+  void visitUnary(const Parser::Unary *u) override {}
+  void visitSingle(const Parser::Single *s) override {}
+  void visitStmt(const Parser::Stmt *s) override {}
+  void visitStmts(const Parser::Stmts *s) override {
+    for (Parser::TreeNode *n : s->stmts) {
+      n->accept(this);
+    }
+  }
+  void visitVar(const Parser::Var *v) override {
+    // The initializer can not refer to the variable being declared
+    if (v->expr)
+      walkExpr(v->expr);
+    std::string id(v->ident.start, v->ident.length);
+    if (symbols->slots.count(id)) {
+      error(v->ident, "Variable already declared");
+      return;
+    }
+    int slot = symbols->size();
+    symbols->slots[id] = slot;
+    symbols->names.push_back(id);
+    symbols->types.push_back(declaredType(v->type.type));
+    const_cast<Parser::Var *>(v)->slot = slot;
+  }
+  void visitAssign(const Parser::Assign *a) override {
+    const_cast<Parser::Assign *>(a)->slot = lookupWritable(a->ident);
+    walkExpr(a->expr);
+  }
+  void visitFor(const Parser::For *f) override {
+    int slot = lookupWritable(f->ident);
+    const_cast<Parser::For *>(f)->slot = slot;
+    if (slot >= 0 && symbols->types[slot] != Runtime::ValueType::INT)
+      error(f->ident, "Loop control variable must be an int");
+    walkExpr(f->from);
+    walkExpr(f->to);
+    controls.insert(slot);
+    f->body->accept(this);
+    controls.erase(slot);
+  }
+  void visitRead(const Parser::Read *r) override {
+    const_cast<Parser::Read *>(r)->slot = lookupWritable(r->ident);
+  }
+  void visitPrint(const Parser::Print *p) override { walkExpr(p->expr); }
+  void visitAssert(const Parser::Assert *a) override { walkExpr(a->expr); }
+
+private:
+  // Control variables of the loops currently being resolved
+  std::set<int> controls;
+
+  void error(Scanner::Token t, const char *msg) {
+    IO::errorf("[line %d] Error at '%.*s': %s\n", t.line, t.length,
+               t.start, msg);
+    hadError = true;
+  }
+  int lookup(Scanner::Token t) {
+    auto it = symbols->slots.find(std::string(t.start, t.length));
+    if (it == symbols->slots.end()) {
+      error(t, "Variable has not been declared");
+      return -1;
+    }
+    return it->second;
+  }
+  int lookupWritable(Scanner::Token t) {
+    int slot = lookup(t);
+    if (slot >= 0 && controls.count(slot))
+      error(t, "Loop control variable can not be written inside the loop");
+    return slot;
+  }
+};
+
+void Symbols::truncate(int size) {
+  for (int i = size; i < (int)names.size(); i++)
+    slots.erase(names[i]);
+  names.resize(size);
+  types.resize(size);
+}
+
+bool resolve(Parser::Stmts *program, Symbols *symbols) {
+  ResolveWalker rw(symbols);
+  program->accept(&rw);
+  return !rw.hadError;
+}
+
+} // namespace Resolver
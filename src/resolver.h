@@ -0,0 +1,33 @@
+#ifndef RESOLVER_H_
+#define RESOLVER_H_
+
+#include "parser.h"
+#include "value.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Resolver {
+
+// Declared variables by slot
+struct Symbols {
+  std::vector<std::string> names;
+  std::vector<Runtime::ValueType> types;
+  std::unordered_map<std::string, int> slots;
+
+  int size() const { return (int)names.size(); }
+  // Forgets the variables declared after the first size ones
+  void truncate(int size);
+};
+
+Runtime::ValueType declaredType(Scanner::TokenType t);
+
+// Assigns every declared variable a dense slot index and stores it on the
+// nodes that refer to the variable. Undeclared and duplicate variables and
+// writes to a loop control variable inside its loop are reported to stderr.
+// Symbols may already hold variables from an earlier program (REPL).
+bool resolve(Parser::Stmts *program, Symbols *symbols);
+
+} // namespace Resolver
+
+#endif // RESOLVER_H_
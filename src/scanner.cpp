@@ -1,5 +1,6 @@
 #include "scanner.h"
-#include <cstdlib>
+#include "charscan.h"
+#include <cstdint>
 #include <cstring>
 #include <iostream>
 
@@ -9,270 +10,280 @@ namespace Scanner {
 std::string TokenName[]{TOKEN_TYPES(F)};
 #undef F
 
-struct Scanner {
-  char *src;
-  const char *start;
-  const char *current;
-  int line;
-};
-
-static Scanner scanner;
+#define F(name, desc) desc,
+std::string TokenLexeme[]{TOKEN_TYPES(F)};
+#undef F
 
-void init(const std::string source) {
-  scanner.src = (char *)std::malloc(source.size() + 1);
-  std::memcpy(scanner.src, source.c_str(), source.size());
-  scanner.start = scanner.src;
-  scanner.current = scanner.src;
-  scanner.line = 1;
+void init(Scanner *scanner, const char *source, const char *end) {
+  scanner->start = source;
+  scanner->current = source;
+  scanner->end = end;
+  scanner->line = 1;
 }
 
 std::string getName(Token t) { return TokenName[static_cast<int>(t.type)]; }
 std::string getName(TokenType t) { return TokenName[static_cast<int>(t)]; }
+std::string getLexeme(TokenType t) {
+  return TokenLexeme[static_cast<int>(t)];
+}
 
-static bool isEnd() { return *scanner.current == '\0'; }
+static bool isEnd(Scanner *scanner) {
+  return scanner->current >= scanner->end;
+}
 
-static Token makeToken(TokenType type) {
+static Token makeToken(Scanner *scanner, TokenType type) {
   Token t;
   t.type = type;
-  t.start = scanner.start;
-  t.length = (int)(scanner.current - scanner.start);
-  t.line = scanner.line;
+  t.start = scanner->start;
+  t.length = (int)(scanner->current - scanner->start);
+  t.line = scanner->line;
   t.message = "";
   return t;
 }
 
-Token errorToken(const char *msg) {
-  Token t = makeToken(TokenType::ERROR);
+Token errorToken(Scanner *scanner, const char *msg) {
+  Token t = makeToken(scanner, TokenType::ERROR);
   t.message = msg;
   return t;
 }
 
-static char peek() { return *scanner.current; }
+// NUL at the end of input
+static char peek(Scanner *scanner) {
+  return isEnd(scanner) ? '\0' : *scanner->current;
+}
+
+static char peekNext(Scanner *scanner) {
+  return scanner->end - scanner->current > 1 ? scanner->current[1] : '\0';
+}
 
-static char advance() {
-  scanner.current++;
-  return scanner.current[-1];
+static char advance(Scanner *scanner) {
+  scanner->current++;
+  return scanner->current[-1];
 }
 
-static bool match(char expected) {
-  if (isEnd())
+static bool match(Scanner *scanner, char expected) {
+  if (isEnd(scanner))
     return false;
-  if (*scanner.current != expected)
+  if (*scanner->current != expected)
     return false;
-  advance();
+  advance(scanner);
   return true;
 }
 
-static bool matchS(std::string e) {
-  if (isEnd())
+static void skipWhitespace(Scanner *scanner) {
+  scanner->current =
+      CharScan::skipSpace(scanner->current, scanner->end, &scanner->line);
+}
+
+// Moves past the next c, counting the lines on the way
+static bool gotoChar(Scanner *scanner, char c) {
+  scanner->current =
+      CharScan::find(scanner->current, scanner->end, c, &scanner->line);
+  if (isEnd(scanner))
     return false;
-  const char *expected = e.c_str();
-  int count = e.length();
-  // printf("Count:%d\n", count);
-  for (int i = 0; i < count - 1; i++) {
-    // printf("Current:%c Expected:%c\n", scanner.current[i], expected[i]);
-    if (scanner.current[i] != expected[i])
-      return false;
-  }
-  scanner.current += count;
+  advance(scanner);
   return true;
 }
 
-static void skipWhitespace() {
+static Token string(Scanner *scanner) {
   for (;;) {
-    char c = peek();
-    switch (c) {
-    case ' ':
-    case '\r':
-    case '\t':
-      advance();
+    scanner->current =
+        CharScan::findQuote(scanner->current, scanner->end, &scanner->line);
+    if (isEnd(scanner))
+      return errorToken(scanner, "Unterminated string.");
+    if (peek(scanner) == '"')
       break;
-    case '\n':
-      scanner.line++;
-      advance();
-      break;
-    default:
-      return;
-    }
+    // A backslash keeps a following quote in the string
+    if (peekNext(scanner) == '\"')
+      advance(scanner);
+    advance(scanner);
   }
+  advance(scanner);
+  return makeToken(scanner, TokenType::STRING_LIT);
 }
 
-static bool gotoChar(char c) {
-  while (!isEnd()) {
-    if (peek() == c) {
-      advance();
-      return true;
-    }
-    advance();
-  }
-  return false;
+static bool isDigit(char c) { return '0' <= c && c <= '9'; }
+
+static bool isAlpha(char c) {
+  return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z');
 }
 
-static Token string() {
-  while (peek() != '"' && !isEnd()) {
-    if (peek() == '\\') {
-      if (scanner.current[1] == '\"') {
-        advance();
-      }
+static Token integer(Scanner *scanner) {
+  scanner->current = CharScan::skipDigits(scanner->current, scanner->end);
+  return makeToken(scanner, TokenType::INTEGER_LIT);
+}
+
+// Keyword table, generated from the lowercase words among the lexemes of
+// TOKEN_TYPES plus the boolean literals. A word is classified with one probe
+// of a perfect hash on its first and last letters and its length, then one
+// 8-byte compare.
+constexpr int KEYWORD_MAX = 8;
+
+struct Keyword {
+  const char *text;
+  int length;
+  TokenType type;
+};
+
+constexpr int lengthOf(const char *s) {
+  int n = 0;
+  while (s[n])
+    n++;
+  return n;
+}
+
+constexpr bool isWord(const char *s) {
+  for (int i = 0; s[i]; i++)
+    if (s[i] < 'a' || s[i] > 'z')
+      return false;
+  return s[0] != '\0' && lengthOf(s) <= KEYWORD_MAX;
+}
+
+#define F(name, desc) {desc, lengthOf(desc), TokenType::name},
+constexpr Keyword KEYWORDS[]{TOKEN_TYPES(F){"true", 4, TokenType::BOOLEAN_LIT},
+                             {"false", 5, TokenType::BOOLEAN_LIT}};
+#undef F
+constexpr int KEYWORD_COUNT = sizeof(KEYWORDS) / sizeof(KEYWORDS[0]);
+
+constexpr int HASH_SIZE = 32;
+
+constexpr unsigned hashWord(const char *s, int length) {
+  return ((unsigned char)s[0] + 3 * (unsigned char)s[length - 1] + length) %
+         HASH_SIZE;
+}
+
+// Keyword padded with NULs, and a mask of its bytes
+struct Entry {
+  char text[KEYWORD_MAX];
+  char mask[KEYWORD_MAX];
+  int length; // 0 for an empty entry
+  TokenType type;
+};
+
+struct KeywordTable {
+  Entry entries[HASH_SIZE];
+  bool perfect;
+};
+
+constexpr KeywordTable makeKeywordTable() {
+  KeywordTable t{};
+  t.perfect = true;
+  for (int i = 0; i < KEYWORD_COUNT; i++) {
+    const Keyword &k = KEYWORDS[i];
+    if (!isWord(k.text))
+      continue;
+    Entry &e = t.entries[hashWord(k.text, k.length)];
+    if (e.length != 0)
+      t.perfect = false;
+    for (int j = 0; j < k.length; j++) {
+      e.text[j] = k.text[j];
+      e.mask[j] = (char)0xff;
     }
-    if (peek() == '\n')
-      scanner.line++;
-    advance();
+    e.length = k.length;
+    e.type = k.type;
   }
-  if (isEnd())
-    return errorToken("Unterminated string.");
-  advance();
-  return makeToken(TokenType::STRING_LIT);
+  return t;
 }
 
-static bool isDigit(char c) { return '0' <= c && c <= '9'; }
+constexpr KeywordTable KEYWORD_TABLE = makeKeywordTable();
+static_assert(KEYWORD_TABLE.perfect,
+              "Keywords collide, change hashWord or HASH_SIZE");
 
-static bool isAlpha(char c) {
-  return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z');
+static uint64_t load(const char *p) {
+  uint64_t w;
+  memcpy(&w, p, sizeof(w));
+  return w;
+}
+
+static TokenType classify(const char *s, int length, const char *end) {
+  const Entry &e = KEYWORD_TABLE.entries[hashWord(s, length)];
+  if (e.length != length)
+    return TokenType::IDENTIFIER;
+  if (end - s >= KEYWORD_MAX) {
+    if ((load(s) & load(e.mask)) != load(e.text))
+      return TokenType::IDENTIFIER;
+  } else if (memcmp(s, e.text, length) != 0) {
+    return TokenType::IDENTIFIER;
+  }
+  return e.type;
 }
 
-static Token integer() {
-  while (isDigit(peek()))
-    advance();
-  return makeToken(TokenType::INTEGER_LIT);
+static bool isIdentChar(char c) {
+  return isAlpha(c) || isDigit(c) || c == '_';
 }
 
-static Token identifier() {
-  while (isAlpha(peek()) || isDigit(peek()) || peek() == '_')
-    advance();
-  return makeToken(TokenType::IDENTIFIER);
+static Token identifier(Scanner *scanner) {
+  // Most names end within this loop; longer ones are left to CharScan
+  const char *p = scanner->current;
+  const char *limit = scanner->end - p > 16 ? p + 16 : scanner->end;
+  while (p < limit && isIdentChar(*p))
+    p++;
+  if (p == limit)
+    p = CharScan::skipIdent(p, scanner->end);
+  scanner->current = p;
+  return makeToken(scanner,
+                   classify(scanner->start, p - scanner->start, scanner->end));
 }
 
-Token scanToken() {
-  skipWhitespace();
-  scanner.start = scanner.current;
-  if (isEnd())
-    return makeToken(TokenType::SCAN_EOF);
-  char c = advance();
+Token scanToken(Scanner *scanner) {
+  skipWhitespace(scanner);
+  scanner->start = scanner->current;
+  if (isEnd(scanner))
+    return makeToken(scanner, TokenType::SCAN_EOF);
+  char c = advance(scanner);
   switch (c) {
   case '/':
-    if (peek() == '/') {
-      gotoChar('\n');
-      return makeToken(TokenType::COMMENT);
+    if (peek(scanner) == '/') {
+      // The newline is left to skipWhitespace, which counts it
+      scanner->current =
+          CharScan::find(scanner->current, scanner->end, '\n', nullptr);
+      return makeToken(scanner, TokenType::COMMENT);
     }
-    if (peek() == '*') {
-      advance();
+    if (peek(scanner) == '*') {
+      advance(scanner);
       for (;;) {
-        gotoChar('*');
-        if (match('/'))
-          return makeToken(TokenType::COMMENT);
+        if (!gotoChar(scanner, '*'))
+          return errorToken(scanner, "Unterminated comment.");
+        if (match(scanner, '/'))
+          return makeToken(scanner, TokenType::COMMENT);
       }
-      return makeToken(TokenType::COMMENT);
     }
-    return makeToken(TokenType::SLASH);
+    return makeToken(scanner, TokenType::SLASH);
   case '(':
-    return makeToken(TokenType::LEFT_PAREN);
+    return makeToken(scanner, TokenType::LEFT_PAREN);
   case ')':
-    return makeToken(TokenType::RIGHT_PAREN);
+    return makeToken(scanner, TokenType::RIGHT_PAREN);
   case '-':
-    return makeToken(TokenType::MINUS);
+    return makeToken(scanner, TokenType::MINUS);
   case '+':
-    return makeToken(TokenType::PLUS);
+    return makeToken(scanner, TokenType::PLUS);
   case '*':
-    return makeToken(TokenType::ASTERISK);
+    return makeToken(scanner, TokenType::ASTERISK);
   case '=':
-    return makeToken(TokenType::EQUAL);
+    return makeToken(scanner, TokenType::EQUAL);
   case '<':
-    return makeToken(TokenType::LESS);
+    return makeToken(scanner, TokenType::LESS);
   case '&':
-    return makeToken(TokenType::AND);
+    return makeToken(scanner, TokenType::AND);
   case '!':
-    return makeToken(TokenType::NOT);
+    return makeToken(scanner, TokenType::NOT);
   case ';':
-    return makeToken(TokenType::SEMICOLON);
+    return makeToken(scanner, TokenType::SEMICOLON);
   case ':':
-    return makeToken(match('=') ? TokenType::ASSIGN : TokenType::COLON);
+    return makeToken(scanner, match(scanner, '=') ? TokenType::ASSIGN
+                                                  : TokenType::COLON);
   case '.':
-    if (match('.'))
-      return makeToken(TokenType::RANGE);
-    break;
-  case 'v':
-    if (matchS("ar ")) {
-      scanner.current--;
-      return makeToken(TokenType::VAR);
-    }
-    break;
-  case 'f':
-    if (matchS("or ")) {
-      scanner.current--;
-      return makeToken(TokenType::FOR);
-    }
-    if (matchS("alse ")) {
-      scanner.current--;
-      return makeToken(TokenType::BOOLEAN_LIT);
-    }
-    break;
-  case 'e':
-    if (matchS("nd ")) {
-      scanner.current--;
-      return makeToken(TokenType::END);
-    }
-    break;
-  case 'i':
-    if (matchS("nt ")) {
-      scanner.current--;
-      return makeToken(TokenType::INT);
-    }
-    if (matchS("n ")) {
-      scanner.current--;
-      return makeToken(TokenType::IN);
-    }
-    break;
-  case 'd':
-    if (matchS("o ")) {
-      scanner.current--;
-      return makeToken(TokenType::DO);
-    }
-    break;
-  case 'r':
-    if (matchS("ead ")) {
-      scanner.current--;
-      return makeToken(TokenType::READ);
-    }
-    break;
-  case 'p':
-    if (matchS("rint ")) {
-      scanner.current--;
-      return makeToken(TokenType::PRINT);
-    }
-    break;
-  case 's':
-    if (matchS("tring ")) {
-      scanner.current--;
-      return makeToken(TokenType::STRING);
-    }
-    break;
-  case 'b':
-    if (matchS("ool ")) {
-      scanner.current--;
-      return makeToken(TokenType::BOOL);
-    }
-    break;
-  case 'a':
-    if (matchS("ssert ")) {
-      scanner.current--;
-      return makeToken(TokenType::ASSERT);
-    }
-    break;
-  case 't':
-    if (matchS("rue ")) {
-      scanner.current--;
-      return makeToken(TokenType::BOOLEAN_LIT);
-    }
+    if (match(scanner, '.'))
+      return makeToken(scanner, TokenType::RANGE);
     break;
   case '"':
-    return string();
+    return string(scanner);
   }
   if (isDigit(c))
-    return integer();
+    return integer(scanner);
   if (isAlpha(c))
-    return identifier();
-  return errorToken("Unexpected character.");
+    return identifier(scanner);
+  return errorToken(scanner, "Unexpected character.");
 }
 
 } // namespace Scanner
@@ -45,6 +45,10 @@ namespace Scanner {
 enum class TokenType { TOKEN_TYPES(F) };
 #undef F
 
+#define F(name, desc) +1
+constexpr int TOKEN_COUNT = 0 TOKEN_TYPES(F);
+#undef F
+
 struct Token {
   TokenType type;
   const char *start;
@@ -53,11 +57,25 @@ struct Token {
   int line;
 };
 
-void init(const std::string source);
+// Position of a scan in progress. Each source is scanned with its own, so
+// separate sources can be scanned concurrently.
+struct Scanner {
+  const char *start;
+  const char *current;
+  const char *end;
+  int line;
+};
+
+// Starts scanning the source text [source, end), which is read in place:
+// tokens point into it, so it must outlive them. No terminating NUL is
+// needed.
+void init(Scanner *scanner, const char *source, const char *end);
 std::string getName(Token t);
 std::string getName(TokenType t);
-Token scanToken();
-Token errorToken(const char *msg);
+// Source text of operators and keywords
+std::string getLexeme(TokenType t);
+Token scanToken(Scanner *scanner);
+Token errorToken(Scanner *scanner, const char *msg);
 
 } // namespace Scanner
 
@@ -0,0 +1,181 @@
+#include "tokens.h"
+#include "charscan.h"
+#include "pool.h"
+#include <algorithm>
+
+namespace Tokens {
+
+// Sources smaller than two parts of this size are scanned on one thread
+static const size_t MIN_PART = 256 * 1024;
+
+const std::vector<uint32_t> &Buffer::newlines() const {
+  if (!indexed) {
+    const char *begin = source.data();
+    const char *end = begin + source.size();
+    for (const char *p = CharScan::find(begin, end, '\n', nullptr); p < end;
+         p = CharScan::find(p + 1, end, '\n', nullptr))
+      newlineIndex.push_back(p - begin);
+    indexed = true;
+  }
+  return newlineIndex;
+}
+
+// Like the scanner, a token is on the line where it ends
+int Buffer::line(uint32_t i) const {
+  const std::vector<uint32_t> &n = newlines();
+  return std::lower_bound(n.begin(), n.end(), offset[i] + length[i]) -
+         n.begin() + 1;
+}
+
+Scanner::Token Buffer::token(uint32_t i) const {
+  Scanner::Token t;
+  t.type = (Scanner::TokenType)type[i];
+  t.start = source.data() + offset[i];
+  t.length = length[i];
+  t.line = line(i);
+  t.message = "";
+  auto e = std::lower_bound(
+      errors.begin(), errors.end(), i,
+      [](const std::pair<uint32_t, const char *> &a, uint32_t b) {
+        return a.first < b;
+      });
+  if (e != errors.end() && e->first == i)
+    t.message = e->second;
+  return t;
+}
+
+// Tokens of the part of a source starting at begin: every token that
+// starts before end, the last one possibly running past it.
+struct Part {
+  const char *begin;
+  const char *end;
+  Buffer tokens;
+  // Start of the first token scanned, and of the token after the part
+  const char *first;
+  const char *stop;
+};
+
+static void scan(std::string_view source, Part *part) {
+  Scanner::Scanner scanner;
+  Scanner::init(&scanner, part->begin, source.data() + source.size());
+  Buffer &b = part->tokens;
+  // About one token per four bytes in typical code
+  size_t expected = (part->end - part->begin) / 4 + 1;
+  b.type.reserve(expected);
+  b.offset.reserve(expected);
+  b.length.reserve(expected);
+  part->first = nullptr;
+  for (;;) {
+    Scanner::Token t = Scanner::scanToken(&scanner);
+    if (!part->first)
+      part->first = t.start;
+    if (t.type == Scanner::TokenType::SCAN_EOF || t.start >= part->end) {
+      part->stop = t.start;
+      return;
+    }
+    if (t.type == Scanner::TokenType::ERROR)
+      b.errors.emplace_back(b.size(), t.message);
+    b.type.push_back((uint8_t)t.type);
+    b.offset.push_back(t.start - source.data());
+    b.length.push_back(t.length);
+  }
+}
+
+// Splits source into parts of about equal size, each starting on the line
+// after a statement
+static std::vector<Part> split(std::string_view source, size_t parts) {
+  const char *begin = source.data();
+  const char *end = begin + source.size();
+  std::vector<const char *> bounds{begin};
+  for (size_t k = 1; k < parts; k++) {
+    const char *limit = begin + source.size() * (k + 1) / parts;
+    const char *p = std::max(begin + source.size() * k / parts, bounds.back());
+    do
+      p = CharScan::find(p + 1, limit, '\n', nullptr);
+    while (p < limit && p[-1] != ';');
+    if (p < limit)
+      bounds.push_back(p + 1);
+  }
+  bounds.push_back(end);
+  std::vector<Part> result(bounds.size() - 1);
+  for (size_t k = 0; k < result.size(); k++) {
+    result[k].begin = bounds[k];
+    result[k].end = bounds[k + 1];
+  }
+  return result;
+}
+
+static void append(Buffer *tokens, const Buffer &part) {
+  uint32_t base = tokens->size();
+  tokens->type.insert(tokens->type.end(), part.type.begin(), part.type.end());
+  tokens->offset.insert(tokens->offset.end(), part.offset.begin(),
+                        part.offset.end());
+  tokens->length.insert(tokens->length.end(), part.length.begin(),
+                        part.length.end());
+  for (const auto &[i, message] : part.errors)
+    tokens->errors.emplace_back(base + i, message);
+}
+
+void tokenize(std::string_view source, Buffer *tokens, unsigned threads) {
+  *tokens = Buffer();
+  if (source.size() > UINT32_MAX) {
+    // Offsets are 32-bit
+    tokens->errors.emplace_back(0, "Source too large.");
+    tokens->type.push_back((uint8_t)Scanner::TokenType::ERROR);
+    tokens->offset.push_back(0);
+    tokens->length.push_back(0);
+  } else {
+    size_t parts = 1;
+    if (threads > 1)
+      parts = std::min<size_t>(4 * threads, source.size() / MIN_PART);
+    std::vector<Part> p = split(source, std::max<size_t>(parts, 1));
+    Pool::parallelFor(p.size(), threads,
+                      [&](size_t k) { scan(source, &p[k]); });
+    const char *expected = source.data();
+    for (Part &part : p) {
+      // Scanned from inside a token of the previous part; the tokens from
+      // where that part stopped are the right ones
+      if (part.first != expected && part.begin != source.data()) {
+        part.begin = expected;
+        part.tokens = Buffer();
+        scan(source, &part);
+      }
+      if (p.size() == 1)
+        *tokens = std::move(part.tokens);
+      else
+        append(tokens, part.tokens);
+      expected = part.stop;
+    }
+  }
+  tokens->source = source;
+  tokens->type.push_back((uint8_t)Scanner::TokenType::SCAN_EOF);
+  tokens->offset.push_back(source.size());
+  tokens->length.push_back(0);
+}
+
+unsigned threadsFor(size_t size) {
+  if (size < 2 * MIN_PART)
+    return 1;
+  return Pool::budget();
+}
+
+Scanner::Token Reader::next() {
+  uint32_t i = index;
+  if (index + 1 < buffer.size())
+    index++;
+  Scanner::Token t;
+  t.type = (Scanner::TokenType)buffer.type[i];
+  t.start = buffer.source.data() + buffer.offset[i];
+  t.length = buffer.length[i];
+  const std::vector<uint32_t> &n = buffer.newlines();
+  uint32_t end = buffer.offset[i] + buffer.length[i];
+  while (newline < n.size() && n[newline] < end)
+    newline++;
+  t.line = newline + 1;
+  t.message = "";
+  if (error < buffer.errors.size() && buffer.errors[error].first == i)
+    t.message = buffer.errors[error++].second;
+  return t;
+}
+
+} // namespace Tokens
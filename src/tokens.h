@@ -0,0 +1,66 @@
+#ifndef TOKENS_H_
+#define TOKENS_H_
+
+#include "scanner.h"
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Whole-source tokenization into a compact structure-of-arrays buffer: 9
+// bytes per token instead of a 32-byte Scanner::Token. Lines are not stored;
+// they come from a newline index built on first use.
+namespace Tokens {
+
+class Buffer {
+public:
+  // Source the offsets are relative to, read in place
+  std::string_view source;
+  std::vector<uint8_t> type; // Scanner::TokenType
+  std::vector<uint32_t> offset;
+  std::vector<uint32_t> length;
+  // Messages of the ERROR tokens, by token index in increasing order
+  std::vector<std::pair<uint32_t, const char *>> errors;
+
+  // Number of tokens, including the final SCAN_EOF
+  size_t size() const { return type.size(); }
+  // Offsets of the newlines in the source
+  const std::vector<uint32_t> &newlines() const;
+  int line(uint32_t i) const;
+  Scanner::Token token(uint32_t i) const;
+
+private:
+  mutable std::vector<uint32_t> newlineIndex;
+  mutable bool indexed = false;
+};
+
+// Tokenizes source into tokens, which ends with a SCAN_EOF token. Large
+// sources are split after statements ending a line and the parts are
+// scanned on up to threads threads. A part whose start turns out to lie
+// inside a token, such as a comment or string spanning the split, is
+// scanned again from the end of the previous one, so the result is always
+// the same as scanning the whole source in one go.
+void tokenize(std::string_view source, Buffer *tokens, unsigned threads);
+
+// Threads worth using for a source of size bytes, within the thread budget
+// of the caller (Pool::budget)
+unsigned threadsFor(size_t size);
+
+// Reads the tokens of a buffer front to back. Lines are found by walking
+// the newline index along with the tokens.
+class Reader {
+public:
+  Reader(const Buffer &b) : buffer(b) {}
+  // Next token; SCAN_EOF once the buffer is exhausted
+  Scanner::Token next();
+
+private:
+  const Buffer &buffer;
+  uint32_t index = 0;
+  size_t newline = 0;
+  size_t error = 0;
+};
+
+} // namespace Tokens
+
+#endif // TOKENS_H_
@@ -0,0 +1,51 @@
+#include "value.h"
+
+namespace Runtime {
+
+std::string getName(ValueType t) {
+  switch (t) {
+  case ValueType::INT:
+    return "int";
+  case ValueType::BOOL:
+    return "bool";
+  case ValueType::STRING:
+    return "string";
+  }
+  return "";
+}
+
+Value Value::concat(const Value &l, const Value &r) {
+  ObjString *s = l.as.s;
+  if (l.length != s->chars.size()) {
+    // Something has been appended to l already, so its text is copied
+    std::string chars;
+    chars.reserve(2 * ((size_t)l.length + r.length));
+    chars.append(l.getString()).append(r.getString());
+    return string(std::move(chars));
+  }
+  // r may be a prefix of the same chars, which append can take from itself
+  if (r.as.s == s)
+    s->chars.append(s->chars, 0, r.length);
+  else
+    s->chars.append(r.getString());
+  Value v;
+  v.type = ValueType::STRING;
+  v.length = s->chars.size();
+  v.as.s = s;
+  s->refs++;
+  return v;
+}
+
+std::string Value::toString() const {
+  switch (type) {
+  case ValueType::INT:
+    return std::to_string(as.i);
+  case ValueType::BOOL:
+    return as.b ? "true" : "false";
+  case ValueType::STRING:
+    return std::string(getString());
+  }
+  return "";
+}
+
+} // namespace Runtime
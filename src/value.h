@@ -0,0 +1,120 @@
+#ifndef VALUE_H_
+#define VALUE_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace Runtime {
+
+enum class ValueType : uint8_t {
+  INT,
+  BOOL,
+  STRING,
+};
+
+std::string getName(ValueType t);
+
+// Heap part of a string value, shared between copies by reference count.
+// A string value is a prefix of chars: concatenation appends to chars in
+// place when the left operand ends where chars does, so building a string
+// by repeated + takes amortized constant time per append. Values sharing
+// chars keep seeing only their own prefix.
+struct ObjString {
+  int refs;
+  std::string chars;
+};
+
+// Tagged value: type tag plus an inline int/bool or a pointer to a shared
+// string. Fits in 16 bytes so value stacks and variable slots stay compact.
+// Values are only turned into text when they are printed.
+class Value {
+public:
+  ValueType type;
+  // Length of the prefix of as.s->chars a string value consists of
+  uint32_t length;
+  union {
+    int32_t i;
+    bool b;
+    ObjString *s;
+  } as;
+
+  Value() : type(ValueType::INT), length(0) { as.i = 0; }
+  Value(const Value &v) : type(v.type), length(v.length), as(v.as) {
+    retain();
+  }
+  Value(Value &&v) noexcept : type(v.type), length(v.length), as(v.as) {
+    v.type = ValueType::INT;
+  }
+  ~Value() { release(); }
+  Value &operator=(const Value &v) {
+    if (this != &v) {
+      v.retain();
+      release();
+      type = v.type;
+      length = v.length;
+      as = v.as;
+    }
+    return *this;
+  }
+  Value &operator=(Value &&v) noexcept {
+    if (this != &v) {
+      release();
+      type = v.type;
+      length = v.length;
+      as = v.as;
+      v.type = ValueType::INT;
+    }
+    return *this;
+  }
+
+  static Value integer(int32_t i) {
+    Value v;
+    v.as.i = i;
+    return v;
+  }
+  static Value boolean(bool b) {
+    Value v;
+    v.type = ValueType::BOOL;
+    v.as.b = b;
+    return v;
+  }
+  static Value string(std::string s) {
+    Value v;
+    v.type = ValueType::STRING;
+    v.length = s.size();
+    v.as.s = new ObjString{1, std::move(s)};
+    return v;
+  }
+  // String l followed by string r
+  static Value concat(const Value &l, const Value &r);
+  // Default value of a freshly declared variable of type t
+  static Value zero(ValueType t) {
+    if (t == ValueType::BOOL)
+      return boolean(false);
+    if (t == ValueType::STRING)
+      return string("");
+    return integer(0);
+  }
+
+  int32_t getInt() const { return as.i; }
+  bool getBool() const { return as.b; }
+  std::string_view getString() const {
+    return std::string_view(as.s->chars.data(), length);
+  }
+  std::string toString() const;
+
+private:
+  void retain() const {
+    if (type == ValueType::STRING)
+      as.s->refs++;
+  }
+  void release() {
+    if (type == ValueType::STRING && --as.s->refs == 0)
+      delete as.s;
+  }
+};
+
+} // namespace Runtime
+
+#endif // VALUE_H_
@@ -0,0 +1,237 @@
+#include "vm.h"
+#include "io.h"
+#include "jit.h"
+#include "ops.h"
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace VM {
+
+using Compiler::OpCode;
+using Runtime::Value;
+
+// The tree walker's expression stack holds only the asserted value at this
+// point; the VM's also holds the end values of the enclosing for loops, which
+// are not shown
+static void printDiag(const Compiler::Chunk &chunk,
+                      const std::vector<Value> &slots, const Value &asserted) {
+  std::map<std::string, const Value *> vars;
+  // Temporaries of the optimizer are named "$tN" and not shown
+  for (size_t i = 0; i < chunk.names.size(); i++)
+    if (chunk.names[i][0] != '$')
+      vars[chunk.names[i]] = &slots[i];
+  IO::out() << "========================\n";
+  IO::out() << "Variable map:\n";
+  for (auto const &[id, var] : vars) {
+    IO::out() << "\t"
+              << "id:" << id << " val:" << var->toString() << std::endl;
+  }
+  IO::out() << "========================\n";
+  IO::out() << "========================\n";
+  IO::out() << "Expr stack:\n";
+  IO::out() << "\t" << Runtime::getName(asserted.type) << ":"
+            << asserted.toString() << "\n";
+  IO::out() << "========================\n";
+}
+
+static void runtimeError(const Compiler::Chunk &chunk, const uint8_t *op,
+                         std::string msg) {
+  size_t offset = op - chunk.code.data();
+  IO::errorf("[line %d] Runtime error: %s\n", chunk.lines[offset],
+             msg.c_str());
+}
+
+Interpreter::InterpretResult run(const Compiler::Chunk &chunk,
+                                 const Interpreter::Options &options,
+                                 Jit::Tier *tier) {
+  std::unique_ptr<Jit::Tier> own;
+  if (options.jit == Interpreter::JitMode::OFF) {
+    tier = nullptr;
+  } else if (!tier) {
+    own.reset(new Jit::Tier(chunk, options.jit, options.jitLog));
+    tier = own.get();
+  }
+  // String constants are copied so that runs of one chunk on several
+  // threads never share a reference count
+  std::vector<Value> constants;
+  constants.reserve(chunk.constants.size());
+  for (const Value &c : chunk.constants)
+    constants.push_back(Value::string(std::string(c.getString())));
+  std::vector<Value> slots(chunk.names.size());
+  std::vector<Value> stackStore(chunk.maxStack + 1);
+  Value *stack = stackStore.data();
+  Value *sp = stack;
+  const uint8_t *ip = chunk.code.data();
+  const uint8_t *op = ip;
+  // The program goes on after a failed assert but ends with a runtime error
+  bool assertFailed = false;
+
+#define READ_WORD()                                                            \
+  (ip += 4, ip[-4] | ip[-3] << 8 | ip[-2] << 16 | (uint32_t)ip[-1] << 24)
+#define PUSH(v) (*sp++ = (v))
+#define POP() (std::move(*--sp))
+#define TOP (sp[-1])
+#define INT_OP(f)                                                              \
+  {                                                                            \
+    int32_t r = (--sp)->as.i;                                                  \
+    TOP.as.i = Runtime::Ops::f(TOP.as.i, r);                                   \
+    break;                                                                     \
+  }
+#define CMP_OP(get, o)                                                         \
+  {                                                                            \
+    Value r = POP();                                                           \
+    Value l = POP();                                                           \
+    PUSH(Value::boolean(l.get() o r.get()));                                   \
+    break;                                                                     \
+  }
+#define READ_OP(type)                                                          \
+  {                                                                            \
+    std::string error;                                                         \
+    if (!Interpreter::readValue(type, &slots[READ_WORD()], &error)) {          \
+      runtimeError(chunk, op, error);                                          \
+      return Interpreter::InterpretResult::RUNTIME_ERROR;                      \
+    }                                                                          \
+    break;                                                                     \
+  }
+
+  for (;;) {
+    op = ip;
+    switch ((OpCode)*ip++) {
+    case OpCode::INT:
+      PUSH(Value::integer((int32_t)READ_WORD()));
+      break;
+    case OpCode::TRUE:
+      PUSH(Value::boolean(true));
+      break;
+    case OpCode::FALSE:
+      PUSH(Value::boolean(false));
+      break;
+    case OpCode::STRING:
+      PUSH(constants[READ_WORD()]);
+      break;
+    case OpCode::GET:
+      PUSH(slots[READ_WORD()]);
+      break;
+    case OpCode::SET:
+      slots[READ_WORD()] = POP();
+      break;
+    case OpCode::POP:
+      *--sp = Value();
+      break;
+    case OpCode::ADD:
+      INT_OP(add)
+    case OpCode::SUB:
+      INT_OP(subtract)
+    case OpCode::MUL:
+      INT_OP(multiply)
+    case OpCode::DIV:
+      if (TOP.as.i == 0) {
+        runtimeError(chunk, op, "Division by zero");
+        return Interpreter::InterpretResult::RUNTIME_ERROR;
+      }
+      sp--;
+      TOP.as.i = Runtime::Ops::divide(TOP.as.i, sp->as.i);
+      break;
+    case OpCode::CONCAT: {
+      Value r = POP();
+      Value l = POP();
+      PUSH(Value::concat(l, r));
+      break;
+    }
+    case OpCode::LESS_INT:
+      CMP_OP(getInt, <)
+    case OpCode::LESS_BOOL:
+      CMP_OP(getBool, <)
+    case OpCode::LESS_STRING:
+      CMP_OP(getString, <)
+    case OpCode::EQUAL_INT:
+      CMP_OP(getInt, ==)
+    case OpCode::EQUAL_BOOL:
+      CMP_OP(getBool, ==)
+    case OpCode::EQUAL_STRING:
+      CMP_OP(getString, ==)
+    case OpCode::AND: {
+      bool r = (--sp)->as.b;
+      TOP.as.b = TOP.as.b && r;
+      break;
+    }
+    case OpCode::NOT:
+      TOP.as.b = !TOP.as.b;
+      break;
+    case OpCode::PRINT_INT:
+      IO::printInt((--sp)->as.i);
+      break;
+    case OpCode::PRINT_BOOL:
+      IO::out() << ((--sp)->as.b ? "true" : "false");
+      break;
+    case OpCode::PRINT_STRING:
+      IO::out() << POP().getString();
+      break;
+    case OpCode::READ_INT:
+      READ_OP(Runtime::ValueType::INT)
+    case OpCode::READ_BOOL:
+      READ_OP(Runtime::ValueType::BOOL)
+    case OpCode::READ_STRING:
+      READ_OP(Runtime::ValueType::STRING)
+    case OpCode::ASSERT:
+      if (!TOP.as.b) {
+        printDiag(chunk, slots, TOP);
+        assertFailed = true;
+      }
+      *--sp = Value();
+      break;
+    case OpCode::FOR_PREP: {
+      Value &control = slots[READ_WORD()];
+      uint32_t exit = READ_WORD();
+      if (tier) {
+        int32_t from = sp[-2].as.i;
+        int32_t to = TOP.as.i;
+        if (Jit::LoopFn fn = tier->enter(op - chunk.code.data(), from, to)) {
+          int64_t failed = fn(slots.data(), from, to);
+          if (failed >= 0) {
+            runtimeError(chunk, chunk.code.data() + failed, "Division by zero");
+            return Interpreter::InterpretResult::RUNTIME_ERROR;
+          }
+          // Leave the stack as FOR_LOOP would have at the exit
+          Value end = POP();
+          TOP = std::move(end);
+          ip += exit;
+          break;
+        }
+      }
+      int32_t to = POP().as.i;
+      control = POP();
+      PUSH(Value::integer(to));
+      if (control.as.i > to)
+        ip += exit;
+      break;
+    }
+    case OpCode::FOR_LOOP: {
+      Value &control = slots[READ_WORD()];
+      uint32_t back = READ_WORD();
+      // Tested before the increment, which wraps around after INT32_MAX
+      bool more = control.as.i != TOP.as.i;
+      control.as.i = Runtime::Ops::add(control.as.i, 1);
+      if (more)
+        ip -= back;
+      break;
+    }
+    case OpCode::RETURN:
+      return assertFailed ? Interpreter::InterpretResult::RUNTIME_ERROR
+                          : Interpreter::InterpretResult::OK;
+    }
+  }
+
+#undef READ_WORD
+#undef PUSH
+#undef POP
+#undef TOP
+#undef INT_OP
+#undef CMP_OP
+#undef READ_OP
+}
+
+} // namespace VM
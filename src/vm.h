@@ -0,0 +1,21 @@
+#ifndef VM_H_
+#define VM_H_
+
+#include "compiler.h"
+#include "interpreter.h"
+#include "jit.h"
+
+namespace VM {
+
+// Executes a compiled chunk with fresh variable slots. The chunk is only
+// read, so it can be run on several threads at once. Hot loops are handed
+// to the JIT unless options.jit is off. Their counters and native code are
+// kept in tier, which must have been created for this chunk, or last for
+// this run only if it is null.
+Interpreter::InterpretResult run(const Compiler::Chunk &chunk,
+                                 const Interpreter::Options &options,
+                                 Jit::Tier *tier = nullptr);
+
+} // namespace VM
+
+#endif // VM_H_
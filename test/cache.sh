@@ -0,0 +1,60 @@
+#!/usr/bin/env bash
+# A cache file is only run by the build that wrote it. Puts the bytecode of
+# test/p1.mpl at the cache path of test/math.mpl, as an older build with
+# other semantics could have left it there, and checks that math.mpl still
+# prints its own result.
+#
+#   test/cache.sh path/to/mini-pl
+set -u
+
+bin=$1
+dir=$(dirname "$0")
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+failed=0
+
+# Header fields, see src/cache.cpp
+VERSION=4
+KEY=8
+BUILD=16
+
+"$bin" --cache-dir "$tmp" "$dir/math.mpl" >/dev/null
+cached=$(ls "$tmp"/*.mplc)
+"$bin" --precompile "$dir/p1.mpl" -o "$tmp/p1.mplc"
+
+# stale <what> <offset> <bytes>: overwrites a header field of the foreign
+# file, or none for an offset of 0, and runs math.mpl from the cache
+stale() {
+  dd if="$cached" of="$tmp/p1.mplc" bs=1 skip=$KEY seek=$KEY count=8 \
+    conv=notrunc 2>/dev/null
+  if [ "$2" != 0 ]; then
+    printf "$3" | dd of="$tmp/p1.mplc" bs=1 seek="$2" conv=notrunc 2>/dev/null
+  fi
+  cp "$tmp/p1.mplc" "$cached"
+  "$bin" --cache-dir "$tmp" "$dir/math.mpl" >"$tmp/out"
+}
+
+# With a matching build the foreign file is taken for the cached program,
+# which shows that the key alone can not tell them apart
+stale "same build" 0
+if ! cmp -s "$dir/p1.out" "$tmp/out"; then
+  echo "FAIL setup: the foreign cache file was not loaded"
+  failed=1
+fi
+
+for field in "build $BUILD \0\0\0\0\0\0\0\0" "version $VERSION \1\0\0\0"; do
+  set -- $field
+  stale "$1" "$2" "$3"
+  if ! cmp -s "$dir/math.out" "$tmp/out"; then
+    echo "FAIL $1: ran the cached bytecode of another $1"
+    diff "$dir/math.out" "$tmp/out"
+    failed=1
+  fi
+  cp "$tmp/p1.mplc" "$tmp/stale.mplc"
+  "$bin" "$tmp/stale.mplc" >/dev/null 2>&1
+  if [ $? != 1 ]; then
+    echo "FAIL $1: a .mplc of another $1 was run"
+    failed=1
+  fi
+done
+exit $failed
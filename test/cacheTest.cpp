@@ -0,0 +1,103 @@
+// Damaged bytecode in a .mplc file must be rejected before the VM runs it.
+// Each case stores a compiled chunk with one defect, which keeps the file's
+// checksum valid, and expects Cache::load to fail.
+#include "cache.h"
+#include "compiler.h"
+#include <cstdio>
+#include <functional>
+#include <unistd.h>
+
+using Compiler::Chunk;
+using Compiler::OpCode;
+
+static const char *SOURCE = "print \"Give a number: \";\n"
+                            "var n : int;\n"
+                            "read n;\n"
+                            "var v : int := 2;\n"
+                            "var i : int;\n"
+                            "for i in 1..n do\n"
+                            "  v := v * i;\n"
+                            "end for;\n"
+                            "print v;\n";
+
+#define F(name, operands) operands,
+static const int Operands[]{OP_CODES(F)};
+#undef F
+
+// Offset of the first instruction with the given opcode
+static size_t find(const Chunk &chunk, OpCode op) {
+  size_t i = 0;
+  while ((OpCode)chunk.code[i] != op)
+    i += 1 + 4 * Operands[chunk.code[i]];
+  return i;
+}
+
+static bool loads(const Chunk &chunk, const std::string &path) {
+  Chunk loaded;
+  return Cache::store(chunk, 1, path) && Cache::load(path, 0, &loaded);
+}
+
+int main() {
+  char path[] = "/tmp/cacheTest.XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0)
+    return 1;
+  close(fd);
+
+  Chunk chunk;
+  {
+    Parser::Program program;
+    Resolver::Symbols symbols;
+    if (!Compiler::analyze(SOURCE, &program, &symbols, false))
+      return 1;
+    Compiler::compile(program.stmts, symbols, &chunk);
+  }
+
+  const std::pair<const char *, std::function<void(Chunk *)>> cases[] = {
+      {"unknown opcode", [](Chunk *c) { c->code[0] = 0xff; }},
+      {"constant out of range",
+       [](Chunk *c) { c->patch32(find(*c, OpCode::STRING) + 1, 99); }},
+      {"slot out of range",
+       [](Chunk *c) { c->patch32(find(*c, OpCode::SET) + 1, 99); }},
+      {"exit inside an instruction",
+       [](Chunk *c) {
+         size_t at = find(*c, OpCode::FOR_PREP) + 5;
+         c->patch32(at, c->read32(at) - 1);
+       }},
+      {"jump before the code",
+       [](Chunk *c) { c->patch32(find(*c, OpCode::FOR_LOOP) + 5, 1000); }},
+      {"stack deeper than maxStack", [](Chunk *c) { c->maxStack = 1; }},
+      {"operands of the wrong type",
+       [](Chunk *c) {
+         c->code[find(*c, OpCode::MUL)] = (uint8_t)OpCode::CONCAT;
+       }},
+      {"read into a slot of another type",
+       [](Chunk *c) { c->types[0] = Runtime::ValueType::STRING; }},
+      {"no return",
+       [](Chunk *c) {
+         c->code.pop_back();
+         c->lines.pop_back();
+       }},
+      {"truncated operand",
+       [](Chunk *c) {
+         c->code.resize(c->code.size() - 3);
+         c->lines.resize(c->code.size());
+       }},
+  };
+
+  int failed = 0;
+  if (!loads(chunk, path)) {
+    printf("FAIL the undamaged chunk was rejected\n");
+    failed++;
+  }
+  for (auto const &[name, damage] : cases) {
+    Chunk damaged = chunk;
+    damage(&damaged);
+    if (loads(damaged, path)) {
+      printf("FAIL %s was loaded\n", name);
+      failed++;
+    }
+  }
+  unlink(path);
+  return failed != 0;
+}
@@ -0,0 +1,54 @@
+#!/usr/bin/env bash
+# Runs one example on every backend, with and without the optimizer, and
+# compares what it prints and its exit status with the expected ones.
+#
+#   test/run.sh path/to/mini-pl test/name
+#
+# test/name.mpl is the program and test/name.out its expected output. Its
+# input is test/name.in if there is one. A first line "// exit: N" gives
+# the expected exit status, 0 otherwise; a program that -c fails to build
+# counts as a compile error (2). test/name.repl instead holds lines typed
+# into the REPL, whose expected output includes the prompts.
+set -u
+
+bin=$1
+base=$2
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+failed=0
+
+# check <what> <status>
+check() {
+  if [ "$2" != "$status" ] || ! cmp -s "$base.out" "$tmp/out"; then
+    echo "FAIL $(basename "$base") $1: exit $2, expected $status"
+    diff "$base.out" "$tmp/out" | head -20
+    failed=1
+  fi
+}
+
+if [ -f "$base.repl" ]; then
+  status=0
+  "$bin" <"$base.repl" >"$tmp/out" 2>/dev/null
+  check repl $?
+  exit $failed
+fi
+
+input=/dev/null
+[ -f "$base.in" ] && input=$base.in
+status=$(sed -n '1s|^// exit: ||p' "$base.mpl")
+status=${status:-0}
+
+for optimize in "" --no-optimize; do
+  for backend in --vm "--vm --jit=force" --walker --flat --stream; do
+    "$bin" $optimize $backend "$base.mpl" <"$input" >"$tmp/out" 2>/dev/null
+    check "$optimize $backend" $?
+  done
+  if "$bin" $optimize -c "$base.mpl" -o "$tmp/aot" >/dev/null 2>&1; then
+    "$tmp/aot" <"$input" >"$tmp/out" 2>/dev/null
+    check "$optimize -c" $?
+  else
+    : >"$tmp/out"
+    check "$optimize -c" 2
+  fi
+done
+exit $failed